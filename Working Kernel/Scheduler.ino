@@ -1,16 +1,15 @@
-#include <Wire.h>
-#include <SPI.h>
-#include <SD.h>
+#include "hal.h"
 #include "scheduler.h"
 #include "eeprom.h"
 #include "distance_task.h"
 #include "led_task.h"
 #include "filesystem.h"
 #include "bluetooth_transfer.h"  // Include Bluetooth transfers
+#include "snapshot.h"
 
 void setup() {
-    Serial.begin(9600);
-    Wire.begin();
+    hal_console_begin(9600);
+    hal_i2c_begin();
     scheduler_init();
 
     // Initialize hardware tasks
@@ -27,9 +26,10 @@ void setup() {
     // Initialize Bluetooth module for file transfers
     bt_init();
 
-    // Register tasks
-    scheduler_register_task("distance", distance_task_wrapper);
-    scheduler_register_task("led", led_task_wrapper);
+    // Bring back the tasks that were admitted before the reset
+    if (snapshot_restore()) {
+        Serial.println(F("Tasks restored from snapshot."));
+    }
 
     // Display available commands
     Serial.println(F("Scheduler Started. Commands:"));
@@ -38,12 +38,19 @@ void setup() {
     Serial.println(F("  CREATE <filename> - Create a file (scheduler must be stopped)"));
     Serial.println(F("  DELETE <filename> - Delete a file (scheduler must be stopped)"));
     Serial.println(F("  VIEW - List files on SD card"));
-    Serial.println(F("  exec <task> [-t duration] [-p priority] - Execute a task"));
+    Serial.println(F("  LOGCSV - Export the binary sensor log to CSV (scheduler must be stopped)"));
+    Serial.println(F("  exec <task> [-t period] [-p priority] [-f] - Execute a task (-f: even if deadlines may be missed)"));
+    Serial.println(F("  feasibility - Per-task WCET, response time and slack"));
     Serial.println(F("  halt <task> - Stop a task"));
     Serial.println(F("  inspect - View task status"));
-    Serial.println(F("  BTGET - Receive file via Bluetooth (scheduler must be stopped)"));
+    Serial.println(F("  stats [reset|bin] - Per-task run times, jitter, overruns and swaps"));
+    Serial.println(F("  events [reset] - Event queue depth, drops, latency and waiting tasks"));
+    Serial.println(F("  restore [on|off] - Show or set restoring tasks from the snapshot at startup"));
+    Serial.println(F("  BTGET [filename] - Receive file via Bluetooth (scheduler must be stopped)"));
     Serial.println(F("  BTSEND <filename> - Send file via Bluetooth (scheduler must be stopped)"));
     Serial.println(F("  BTDIAG - Run Bluetooth module diagnostic"));
+    Serial.println(F("  BTBAUD [rate] - Find or change the Bluetooth baud rate (scheduler must be stopped)"));
+    Serial.println(F("  loglevel [0-3] - Show or set log level (0 error .. 3 debug)"));
 }
 
 void loop() {
@@ -51,4 +58,5 @@ void loop() {
     if (isSchedulerRunning()) {
         scheduler_run();
     }
+    scheduler_idle();
 }
@@ -0,0 +1,192 @@
+#include "admission.h"
+#include "scheduler.h"
+#include "task_stats.h"
+#include "preempt.h"
+
+// The admitted set, with one task possibly added or re-keyed
+struct AdmissionSet {
+    int candidate;  // -1 for the set as it is
+    uint16_t period;
+    int priority;
+    unsigned long swapUs;  // added to every C, see admission.h
+};
+
+static bool in_set(const AdmissionSet* set, int i) {
+    return i == set->candidate || taskList[i].active || taskList[i].swapped;
+}
+
+static uint16_t set_period(const AdmissionSet* set, int i) {
+    return i == set->candidate ? set->period : taskList[i].period;
+}
+
+#if SCHED_POLICY != SCHED_EDF
+static int set_priority(const AdmissionSet* set, int i) {
+    return i == set->candidate ? set->priority : taskList[i].priority;
+}
+#endif
+
+static unsigned long period_ms(const AdmissionSet* set, int i) {
+    return (unsigned long)set_period(set, i) * TASK_TICK_MS;
+}
+
+static bool analysed(const AdmissionSet* set, int i) {
+    return in_set(set, i) && set_period(set, i) > 0;
+}
+
+static unsigned long cost_us(const AdmissionSet* set, int i) {
+    return task_stats_wcet(i) + set->swapUs;
+}
+
+static unsigned long swap_cost_us(int candidate) {
+    int admitted = 0;
+    unsigned long worst = 0;
+    for (int i = 0; i < TASK_COUNT; i++) {
+        if (i == candidate || taskList[i].active || taskList[i].swapped) admitted++;
+        if (taskStats[i].swapMaxUs > worst) worst = taskStats[i].swapMaxUs;
+    }
+    if (admitted <= MAX_TASKS) return 0;
+    return 2 * (worst > 0 ? worst : ADMISSION_SWAP_US_DEFAULT);
+}
+
+// Longest a job of task i can wait for another task's run to finish
+static unsigned long blocking_us(const AdmissionSet* set, int i) {
+    unsigned long blocking = 0;
+#if KERNEL_PREEMPTIVE
+    (void)set;
+    (void)i;
+#else
+    for (int j = 0; j < TASK_COUNT; j++) {
+        if (j == i || !in_set(set, j)) continue;
+#if SCHED_POLICY == SCHED_EDF
+        // Under EDF only a task with a later deadline can be in the way
+        if (set_period(set, j) > 0 && set_period(set, j) <= set_period(set, i)) continue;
+#else
+        // Background tasks rank behind every periodic one, whatever their priority
+        if (set_period(set, j) > 0 && set_priority(set, j) >= set_priority(set, i)) continue;
+#endif
+        unsigned long run = taskStats[j].execMaxUs + set->swapUs;
+        if (run > blocking) blocking = run;
+    }
+#endif
+    return blocking;
+}
+
+// Utilisation in per mille, rounded up
+static unsigned long utilisation(const AdmissionSet* set) {
+    unsigned long total = 0;
+    for (int i = 0; i < TASK_COUNT; i++) {
+        if (!analysed(set, i)) continue;
+        unsigned long t = period_ms(set, i);
+        total += (cost_us(set, i) + t - 1) / t;
+    }
+    return total;
+}
+
+#if SCHED_POLICY != SCHED_EDF
+// Worst-case response time in us; anything over the period means a miss
+static unsigned long response_us(const AdmissionSet* set, int i) {
+    unsigned long limit = period_ms(set, i) * 1000UL;
+    unsigned long base = cost_us(set, i) + blocking_us(set, i);
+    if (base > limit) return base;
+    unsigned long r = base;
+    for (;;) {
+        unsigned long next = base;
+        for (int j = 0; j < TASK_COUNT; j++) {
+            if (j == i || !analysed(set, j) || set_priority(set, j) < set_priority(set, i)) continue;
+            unsigned long tj = period_ms(set, j) * 1000UL;
+            unsigned long cj = cost_us(set, j);
+            unsigned long releases = (r + tj - 1) / tj;
+            if (cj > 0 && releases > (limit - next) / cj) return limit + 1;
+            next += releases * cj;
+        }
+        if (next == r) return r;
+        r = next;
+    }
+}
+#endif
+
+static void print_us(const __FlashStringHelper* label, unsigned long us) {
+    Serial.print(label);
+    Serial.print(us);
+    Serial.print(F(" us"));
+}
+
+#if SCHED_POLICY == SCHED_EDF
+// Processor demand in one period: the set's share of it plus blocking
+static unsigned long demand_us(const AdmissionSet* set, int i) {
+    unsigned long u = utilisation(set);
+    unsigned long demand = u > 1000 ? period_ms(set, i) * 1000UL + 1 : period_ms(set, i) * u;
+    return demand + blocking_us(set, i);
+}
+#else
+static unsigned long demand_us(const AdmissionSet* set, int i) {
+    return response_us(set, i);
+}
+#endif
+
+static bool meets_deadline(const AdmissionSet* set, int i) {
+    return demand_us(set, i) <= period_ms(set, i) * 1000UL;
+}
+
+static void print_task(const AdmissionSet* set, int i) {
+    unsigned long periodUs = period_ms(set, i) * 1000UL;
+    unsigned long demand = demand_us(set, i);
+    Serial.print(scheduler_task_name(i));
+    Serial.print(F(" | T "));
+    Serial.print(period_ms(set, i));
+    Serial.print(F(" ms"));
+    print_us(F(" | C "), cost_us(set, i));
+    if (task_stats_wcet(i) == 0) Serial.print(F(" (unmeasured)"));
+    if (demand <= periodUs) {
+        print_us(F(" | R "), demand);
+        print_us(F(" | slack "), periodUs - demand);
+        Serial.println();
+    } else {
+        Serial.println(F(" | misses its deadline"));
+    }
+}
+
+bool admission_admit(int index, uint16_t period, int priority, bool force) {
+    AdmissionSet set = { index, period, priority, swap_cost_us(index) };
+    AdmissionSet current = { -1, 0, 0, swap_cost_us(-1) };
+    bool admitted = true;
+    for (int i = 0; i < TASK_COUNT; i++) {
+        if (!analysed(&set, i) || meets_deadline(&set, i)) continue;
+        // A task already missing (after an earlier -f) does not block others
+        if (i != index && analysed(&current, i) && !meets_deadline(&current, i)) continue;
+        if (admitted) Serial.println(F("Admission check failed:"));
+        admitted = false;
+        print_task(&set, i);
+    }
+    if (admitted) return true;
+    if (force) {
+        Serial.println(F("Admitted anyway (-f)."));
+        return true;
+    }
+    Serial.println(F("Not admitted. Use a longer -t, or -f to force."));
+    return false;
+}
+
+void admission_report() {
+    AdmissionSet set = { -1, 0, 0, swap_cost_us(-1) };
+#if SCHED_POLICY == SCHED_EDF
+    Serial.println(F("\n--- Feasibility (EDF) ---"));
+#else
+    Serial.println(F("\n--- Feasibility (fixed priority) ---"));
+#endif
+    bool feasible = true;
+    for (int i = 0; i < TASK_COUNT; i++) {
+        if (!analysed(&set, i)) continue;
+        print_task(&set, i);
+        if (!meets_deadline(&set, i)) feasible = false;
+    }
+    unsigned long u = utilisation(&set);
+    Serial.print(F("Utilisation: "));
+    Serial.print(u / 10);
+    Serial.print('.');
+    Serial.print(u % 10);
+    print_us(F("% | swap cost per job: "), set.swapUs);
+    Serial.println();
+    Serial.println(feasible ? F("All deadlines met.") : F("Deadlines can be missed."));
+    Serial.println(F("------------------------------------"));
+}
@@ -0,0 +1,29 @@
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+#include <Arduino.h>
+
+// Admission control. Before "exec" admits or re-keys a task, the admitted
+// set is checked with it, using each task's measured WCET (task_stats)
+// and its period as the deadline:
+//   fixed priority: response-time analysis. R = C + B + sum over tasks
+//     of equal or higher priority of ceil(R / Tj) * Cj, where B is the
+//     longest run of a lower-priority task (0 in preemptive mode).
+//   EDF: total utilisation sum(C / T) must not exceed 1.
+// When more tasks are admitted than MAX_TASKS can hold, every job may
+// need a swap in and a swap out first, so twice the longest measured
+// swap is added to each C. Tasks with period 0 run whenever nothing else
+// is ready and are not analysed; they only count as blocking. A task that never ran counts as C = 0
+// and is reported as unmeasured.
+
+// Swap cost assumed until a swap has been measured: one EEPROM page write
+#define ADMISSION_SWAP_US_DEFAULT 5000UL
+
+// Would the admitted set, with task index at this period (TASK_TICK_MS
+// ticks) and priority, meet every deadline? Prints why not. With force
+// the task is admitted anyway, after the warning.
+bool admission_admit(int index, uint16_t period, int priority, bool force);
+// Per-task WCET, response time and slack of the admitted set
+void admission_report();
+
+#endif
@@ -0,0 +1,176 @@
+#include "bench.h"
+#if KERNEL_BENCHMARK
+#include "scheduler.h"
+#include "commands.h"
+#include "task_stats.h"
+#include "bt_link.h"
+#include "bluetooth_transfer.h"
+#include "hal.h"
+#include "klog.h"
+
+struct BenchSample {
+    unsigned int count;
+    unsigned long minUs;
+    unsigned long maxUs;
+    float mean;
+    float m2;  // Welford running sum of squared deviations
+};
+
+static void sample_reset(BenchSample* s) {
+    s->count = 0;
+    s->minUs = 0xFFFFFFFFUL;
+    s->maxUs = 0;
+    s->mean = 0;
+    s->m2 = 0;
+}
+
+static void sample_add(BenchSample* s, unsigned long us) {
+    s->count++;
+    if (us < s->minUs) s->minUs = us;
+    if (us > s->maxUs) s->maxUs = us;
+    float delta = us - s->mean;
+    s->mean += delta / s->count;
+    s->m2 += delta * (us - s->mean);
+}
+
+static void sample_print(const __FlashStringHelper* metric, unsigned long param, const BenchSample* s) {
+    Serial.print(F("BENCH,"));
+    Serial.print(metric);
+    Serial.print(',');
+    Serial.print(param);
+    Serial.print(',');
+    Serial.print(s->count);
+    Serial.print(',');
+    Serial.print(s->minUs);
+    Serial.print(',');
+    Serial.print(s->mean, 1);
+    Serial.print(',');
+    Serial.print(s->maxUs);
+    Serial.print(',');
+    Serial.println(s->count > 1 ? sqrt(s->m2 / (s->count - 1)) : 0.0, 1);
+    Serial.flush();
+}
+
+void bench_noop() {
+}
+
+// Scheduler dispatch with `tasks` ready no-op tasks (period 0, always due)
+static void bench_dispatch(int tasks) {
+    BenchSample s;
+    sample_reset(&s);
+    isPaused = false;
+    for (int i = 0; i < BENCH_ITERATIONS * tasks; i++) {
+        unsigned long began = hal_micros();
+        scheduler_run();
+        sample_add(&s, hal_micros() - began);
+    }
+    isPaused = true;
+    sample_print(F("dispatch"), tasks, &s);
+}
+
+// Swap out (dirty and clean) and swap in of one scratch task
+static void bench_swap(int slot) {
+    BenchSample dirty, clean, in;
+    sample_reset(&dirty);
+    sample_reset(&clean);
+    sample_reset(&in);
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        unsigned long began;
+        if (i & 1) {
+            // Changes one field so the image differs from the stored record
+            taskList[slot].priority ^= 1;
+            began = hal_micros();
+            swap_out_task(slot);
+            sample_add(&dirty, hal_micros() - began);
+        } else {
+            began = hal_micros();
+            swap_out_task(slot);
+            sample_add(&clean, hal_micros() - began);
+        }
+        began = hal_micros();
+        swap_in_task(slot);
+        sample_add(&in, hal_micros() - began);
+    }
+    sample_print(F("swap_out_dirty"), sizeof(ScheduledTask), &dirty);
+    sample_print(F("swap_out_clean"), sizeof(ScheduledTask), &clean);
+    sample_print(F("swap_in"), sizeof(ScheduledTask), &in);
+}
+
+// Tokenize, look up and run a command line, output included
+static const char benchLines[][12] PROGMEM = { "loglevel", "VIEW", "nosuchcmd" };
+
+static void bench_commands() {
+    char line[CMD_BUFFER_SIZE];
+    for (byte c = 0; c < sizeof(benchLines) / sizeof(benchLines[0]); c++) {
+        BenchSample s;
+        sample_reset(&s);
+        for (int i = 0; i < BENCH_ITERATIONS / 8; i++) {
+            strcpy_P(line, benchLines[c]);
+            Serial.flush();
+            unsigned long began = hal_micros();
+            command_execute(line);
+            sample_add(&s, hal_micros() - began);
+        }
+        Serial.print(F("BENCH_LINE,"));
+        Serial.print(c);
+        Serial.print(',');
+        Serial.println(reinterpret_cast<const __FlashStringHelper*>(benchLines[c]));
+        sample_print(F("command"), c, &s);
+    }
+}
+
+// Time to push one BT frame's worth of bytes into the link
+static void bench_bt_link() {
+    BenchSample s;
+    sample_reset(&s);
+    uint8_t frame[BT_FRAME_PAYLOAD + 5];  // SOH, seq, len, payload, CRC
+    memset(frame, 0x55, sizeof(frame));
+    for (int i = 0; i < BENCH_ITERATIONS / 4; i++) {
+        btLink.flush();
+        unsigned long began = hal_micros();
+        btLink.write(frame, sizeof(frame));
+        btLink.flush();
+        sample_add(&s, hal_micros() - began);
+    }
+    sample_print(F("bt_frame"), bt_link_baud(), &s);
+}
+
+void bench_run() {
+    if (activeTaskCount > 0) {
+        Serial.println(F("Halt all tasks before running the benchmark."));
+        return;
+    }
+    for (int i = 0; i < TASK_COUNT; i++) {
+        if (taskList[i].swapped) {
+            Serial.println(F("Halt all tasks before running the benchmark."));
+            return;
+        }
+    }
+    int slots = BENCH_TASK_COUNT;
+    if (slots > MAX_TASKS) slots = MAX_TASKS;
+
+    // Swap traces would flood the log ring and skew the drop counter
+    byte savedLevel = klogLevel;
+    klogLevel = KLOG_ERROR;
+    Serial.println(F("# metric,param,count,min_us,mean_us,max_us,stddev_us"));
+    char name[] = "bench0";
+    for (int k = 0; k < slots; k++) {
+        name[5] = '0' + k;
+        scheduler_add_task(name, 0, k, false);
+        bench_dispatch(k + 1);
+    }
+    name[5] = '0';
+    bench_swap(task_registry_find(name));
+    for (int k = 0; k < slots; k++) {
+        name[5] = '0' + k;
+        scheduler_remove_task(name);
+        task_stats_clear(task_registry_find(name));
+    }
+
+    bench_commands();
+    bench_bt_link();
+    klogLevel = savedLevel;
+    Serial.println(F("BENCH,done"));
+}
+
+#endif
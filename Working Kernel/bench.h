@@ -0,0 +1,32 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <Arduino.h>
+#include "kernel_config.h"
+
+// On-target micro benchmarks, built only with KERNEL_BENCHMARK set to 1
+// in kernel_config.h (it adds the "bench" command and about 2 KB of flash).
+
+#define BENCH_ITERATIONS 64
+
+#if KERNEL_BENCHMARK
+#define BENCH_TASK_COUNT 3
+
+// Scratch tasks bench0 .. bench2, registry entries like any other task
+void bench_noop();
+// Stacks of their own, so a preemptive build measures the switch
+#define BENCH_TASKS(X)                          \
+    X("bench0", bench_noop, NULL, 0, 0, 0, 96)  \
+    X("bench1", bench_noop, NULL, 0, 1, 0, 96)  \
+    X("bench2", bench_noop, NULL, 0, 2, 0, 96)
+#else
+#define BENCH_TASKS(X)
+#endif
+
+// Runs every benchmark and prints one CSV line per metric:
+//   BENCH,<metric>,<param>,<count>,<min_us>,<mean_us>,<max_us>,<stddev_us>
+// Needs the scheduler stopped with no task admitted; the benchmark
+// admits its scratch tasks and halts them again afterwards.
+void bench_run();
+
+#endif
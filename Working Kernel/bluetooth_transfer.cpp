@@ -1,233 +1,330 @@
 #include "bluetooth_transfer.h"
 #include "filesystem.h"
-#include <SoftwareSerial.h>
+#include "bt_link.h"
+#include "hal.h"
 
-// Define Bluetooth module pins (RX, TX)
-SoftwareSerial btSerial(6, 7);  // RX, TX for Arduino
 bool btTransferActive = false;
 
 void bt_init() {
-  btSerial.begin(9600);  // Default HC-06 baud rate
+  bt_link_begin(BT_LINK_DEFAULT_BAUD);
   Serial.println(F("Bluetooth module initialized"));
 }
 
+uint16_t bt_crc16(uint16_t crc, const uint8_t* data, size_t length) {
+  while (length--) {
+    crc ^= (uint16_t)*data++ << 8;
+    for (byte bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+  }
+  return crc;
+}
+
+static void bt_write_frame(byte seq, const uint8_t* payload, byte length) {
+  uint8_t head[3] = { BT_SOH, seq, length };
+  uint16_t crc = bt_crc16(0xFFFF, head + 1, 2);
+  crc = bt_crc16(crc, payload, length);
+  uint8_t tail[2] = { (uint8_t)(crc >> 8), (uint8_t)(crc & 0xFF) };
+  btLink.write(head, sizeof(head));
+  btLink.write(payload, length);
+  btLink.write(tail, sizeof(tail));
+}
+
+// Builds and sends frame number `frame` (absolute, the wire carries the low byte)
+static bool bt_send_frame(FsFile dataFile, const char* filename, unsigned long frame, unsigned long frameCount) {
+  uint8_t payload[BT_FRAME_PAYLOAD];
+  byte length = 0;
+  if (frame == 0) {
+    unsigned long size = fs_length(dataFile);
+    for (byte i = 0; i < 4; i++) payload[length++] = (size >> (8 * i)) & 0xFF;
+    while (*filename && length < BT_FRAME_PAYLOAD) payload[length++] = *filename++;
+  } else if (frame < frameCount - 1) {
+    // A go-back resends frames that are usually still in the fs cache
+    int got = fs_read_at(dataFile, (frame - 1) * BT_FRAME_PAYLOAD, payload, BT_FRAME_PAYLOAD);
+    if (got < 0) return false;
+    length = got;
+  }
+  bt_write_frame(frame & 0xFF, payload, length);
+  return true;
+}
+
+// Waits for an ACK/NAK/CAN and its sequence byte, skipping line noise
+static byte bt_wait_reply(byte* seq, unsigned long timeout) {
+  unsigned long start = hal_millis();
+  byte type = 0;
+  while (hal_millis() - start < timeout) {
+    if (!btLink.available()) continue;
+    byte c = btLink.read();
+    if (type == 0) {
+      if (c == BT_CAN) return BT_CAN;
+      if (c == BT_ACK || c == BT_NAK) type = c;
+    } else {
+      *seq = c;
+      return type;
+    }
+  }
+  return 0;
+}
+
 void bt_send_file(const char* filename) {
-  if (!SD.exists(filename)) {
+  if (!fs_exists(filename)) {
     Serial.print(F("File not found: "));
     Serial.println(filename);
     return;
   }
-  
+  FsFile dataFile = fs_open(filename, FS_READ);
+  if (dataFile == FS_NO_FILE) {
+    Serial.println(F("Error opening file"));
+    return;
+  }
+
   btTransferActive = true;
   Serial.print(F("Sending file via Bluetooth: "));
   Serial.println(filename);
-  
-  // Send file header
-  btSerial.print("START:");
-  btSerial.println(filename);
-  
-  // Open file and send contents
-  File dataFile = SD.open(filename);
-  if (dataFile) {
-    while (dataFile.available()) {
-      char c = dataFile.read();
-      btSerial.write(c);
-      // Small delay to prevent buffer overflow
-      delay(10);
+
+  // Header frame, data frames, empty end frame
+  unsigned long fileSize = fs_length(dataFile);
+  unsigned long frameCount = 2 + (fileSize + BT_FRAME_PAYLOAD - 1) / BT_FRAME_PAYLOAD;
+  unsigned long base = 0;  // oldest unacknowledged frame
+  unsigned long next = 0;  // next frame to send
+  byte retries = 0;
+  bool failed = false;
+  unsigned long startTime = hal_millis();
+  unsigned long windowTime = startTime;  // last progress or go-back
+
+  while (!failed && base < frameCount) {
+    // Fill the window
+    while (next < base + BT_WINDOW && next < frameCount) {
+      if (!bt_send_frame(dataFile, filename, next, frameCount)) {
+        Serial.println(F("Error reading file"));
+        failed = true;
+        break;
+      }
+      next++;
+    }
+    if (failed) break;
+
+    // Stale replies do not restart the timeout
+    byte seq = 0;
+    unsigned long waited = hal_millis() - windowTime;
+    byte reply = waited < BT_ACK_TIMEOUT ? bt_wait_reply(&seq, BT_ACK_TIMEOUT - waited) : 0;
+    // Map the 8-bit sequence back onto the window [base, next)
+    unsigned long frame = base + (byte)(seq - (byte)base);
+    if (reply == BT_CAN) {
+      Serial.println(F("Transfer cancelled by receiver"));
+      failed = true;
+    } else if (reply != 0 && frame >= next) {
+      // Outside the window: the receiver re-ACKs duplicates of frames it
+      // already has, and replies to frames sent before a go-back can
+      // still be on the way. Neither means anything is missing.
+    } else if (reply == BT_ACK) {
+      base = frame + 1;
+      retries = 0;
+      windowTime = hal_millis();
+    } else {
+      // NAK or timeout: go back to the first frame the receiver is missing
+      if (reply == BT_NAK) base = frame;
+      next = base;
+      windowTime = hal_millis();
+      if (++retries > BT_MAX_RETRIES) {
+        Serial.println(F("Bluetooth transfer failed: no acknowledgement"));
+        failed = true;
+      }
     }
-    dataFile.close();
-    
-    // Send end marker
-    btSerial.println("END:TRANSFER");
-    Serial.println(F("File sent successfully"));
-  } else {
-    Serial.println(F("Error opening file"));
   }
-  
+  fs_close(dataFile);
+
+  if (!failed) {
+    Serial.print(F("File sent successfully ("));
+    Serial.print(fileSize);
+    Serial.print(F(" bytes in "));
+    Serial.print(hal_millis() - startTime);
+    Serial.println(F(" ms)"));
+  }
   btTransferActive = false;
 }
 
-// void bt_receive_file() {
-//   btTransferActive = true;
-//   Serial.println(F("Waiting for Bluetooth file transfer..."));
-//   Serial.println(F("Send file with format: START:filename followed by content then END:TRANSFER"));
-  
-//   String header = "";
-//   bool receivingHeader = true;
-//   bool receivingContent = false;
-//   String filename = "";
-//   File outputFile;
-  
-//   unsigned long timeout = millis() + 30000; // 30 second timeout
-  
-//   while (millis() < timeout) {
-//     if (btSerial.available()) {
-//       timeout = millis() + 30000; // Reset timeout on activity
-      
-//       if (receivingHeader) {
-//         char c = btSerial.read();
-//         if (c == '\n') {
-//           // Process header
-//           if (header.startsWith("START:")) {
-//             filename = header.substring(6);
-//             filename.trim();
-//             Serial.print(F("Receiving file: "));
-//             Serial.println(filename);
-            
-//             // Create or overwrite the file
-//             if (SD.exists(filename.c_str())) {
-//               SD.remove(filename.c_str());
-//             }
-//             outputFile = SD.open(filename.c_str(), FILE_WRITE);
-            
-//             if (!outputFile) {
-//               Serial.println(F("Error creating output file"));
-//               btTransferActive = false;
-//               return;
-//             }
-            
-//             receivingHeader = false;
-//             receivingContent = true;
-//             header = "";
-//           } else {
-//             header = "";
-//           }
-//         } else {
-//           header += c;
-//         }
-//       } else if (receivingContent) {
-//         // Check for end marker
-//         if (btSerial.available() >= 12) { // Length of "END:TRANSFER"
-//           String endCheck = "";
-//           for (int i = 0; i < 12; i++) {
-//             char c = btSerial.peek();
-//             endCheck += c;
-//             btSerial.read(); // Remove from buffer
-//           }
-          
-//           if (endCheck == "END:TRANSFER") {
-//             outputFile.close();
-//             Serial.println(F("File received successfully"));
-//             btTransferActive = false;
-//             return;
-//           } else {
-//             // Not the end marker, write the first character to the file
-//             outputFile.write(endCheck[0]);
-//             // Put the other characters back in the check buffer
-//             for (int i = 1; i < 12; i++) {
-//               char c = endCheck[i];
-//               outputFile.write(c);
-//             }
-//           }
-//         } else {
-//           // Still receiving content
-//           char c = btSerial.read();
-//           outputFile.write(c);
-//         }
-//       }
-//     }
-//   }
-  
-//   // If we get here, it's a timeout
-//   Serial.println(F("Bluetooth transfer timed out"));
-//   if (outputFile) {
-//     outputFile.close();
-//   }
-//   btTransferActive = false;
-// }
-
-void bt_receive_file() {
+static const char btStartMarker[] PROGMEM = "START:";
+static const char btEndMarker[] PROGMEM = "END_TRANSFER";
+
+// Longest proper prefix of the marker that is also a suffix of its first
+// `matched` characters, i.e. how much of a partial match survives a mismatch
+static byte bt_marker_fallback(const char* marker, byte matched) {
+  for (byte k = matched - 1; k > 0; k--) {
+    byte i = 0;
+    while (i < k && pgm_read_byte(marker + i) == pgm_read_byte(marker + matched - k + i)) i++;
+    if (i == k) return k;
+  }
+  return 0;
+}
+
+static bool bt_valid_name_char(char c) {
+  return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') ||
+         c == '.' || c == '_' || c == '-' || c == '~';
+}
+
+struct BtReceiveState {
+  byte state;
+  byte matched;                  // marker characters matched so far
+  char name[BT_RX_NAME_MAX + 1];
+  byte nameLength;
+  unsigned long received;
+  bool failed;
+  FsFile file;
+};
+
+// The fs cache collects the bytes and writes them a line at a time
+static void bt_rx_emit(BtReceiveState* rx, uint8_t c) {
+  rx->received++;
+  if (fs_append(rx->file, &c, 1) != 1) rx->failed = true;
+}
+
+static bool bt_rx_open(BtReceiveState* rx, const char* filename) {
+  if (filename == NULL) {
+    filename = rx->nameLength > 0 ? rx->name : "received.txt";
+  }
+  Serial.print(F("Saving file as: "));
+  Serial.println(filename);
+  if (fs_exists(filename)) {
+    Serial.println(F("File already exists. Overwriting..."));
+    fs_remove(filename);
+  }
+  rx->file = fs_open(filename, FS_WRITE);
+  return rx->file != FS_NO_FILE;
+}
+
+// Feeds one byte through the START header / content / END marker machine.
+// Returns true once the end marker has been seen.
+static bool bt_rx_feed(BtReceiveState* rx, char c, const char* filename) {
+  switch (rx->state) {
+  case BT_RX_WAIT_START:
+    if (c == (char)pgm_read_byte(btStartMarker + rx->matched)) {
+      if (++rx->matched == sizeof(btStartMarker) - 1) {
+        rx->state = BT_RX_NAME;
+        rx->matched = 0;
+      }
+    } else {
+      rx->matched = (c == (char)pgm_read_byte(btStartMarker)) ? 1 : 0;
+    }
+    return false;
+
+  case BT_RX_NAME:
+    if (c == '\n') {
+      rx->name[rx->nameLength] = '\0';
+      if (!bt_rx_open(rx, filename)) {
+        Serial.println(F("Error creating output file"));
+        rx->failed = true;
+        return false;
+      }
+      rx->state = BT_RX_CONTENT;
+    } else if (bt_valid_name_char(c) && rx->nameLength < BT_RX_NAME_MAX) {
+      rx->name[rx->nameLength++] = c;
+    }
+    // Spaces, '\r' and characters not allowed in 8.3 names are dropped
+    return false;
+
+  default:
+    for (;;) {
+      if (c == (char)pgm_read_byte(btEndMarker + rx->matched)) {
+        return ++rx->matched == sizeof(btEndMarker) - 1;
+      }
+      if (rx->matched == 0) {
+        bt_rx_emit(rx, c);
+        return false;
+      }
+      // Release the part of the partial match that can no longer be the marker
+      byte keep = bt_marker_fallback(btEndMarker, rx->matched);
+      for (byte i = 0; i < rx->matched - keep; i++) {
+        bt_rx_emit(rx, pgm_read_byte(btEndMarker + i));
+      }
+      rx->matched = keep;
+    }
+  }
+}
+
+void bt_receive_file(const char* filename) {
   // Make sure SD card is initialized first
   if (!initSDCard()) {
     Serial.println(F("Cannot receive file - SD card not initialized."));
     return;
   }
-  
+
   btTransferActive = true;
   Serial.println(F("Waiting for Bluetooth file transfer..."));
-  Serial.println(F("Send file with format: START: content END_TRANSFER"));
-  
-  unsigned long startTime = millis();
-  String fullMessage = "";
-  bool messageReceived = false;
-  
-  // Wait up to 60 seconds for a message from btSerial
-  while (millis() - startTime < 60000) { 
-    if (btSerial.available()) {
-      fullMessage = btSerial.readStringUntil('\n');
-      fullMessage.trim();
-      messageReceived = true;
-      break;
+  Serial.println(F("Send file with format: START:<filename> newline, content, END_TRANSFER"));
+
+  BtReceiveState rx;
+  rx.state = BT_RX_WAIT_START;
+  rx.matched = 0;
+  rx.nameLength = 0;
+  rx.received = 0;
+  rx.failed = false;
+  rx.file = FS_NO_FILE;
+
+  unsigned long startTime = hal_millis();
+  unsigned long lastActivity = startTime;
+  bool complete = false;
+
+  while (!complete && !rx.failed) {
+    unsigned long timeout = rx.state == BT_RX_CONTENT ? BT_RX_IDLE_TIMEOUT : BT_RX_START_TIMEOUT;
+    if (hal_millis() - lastActivity >= timeout) break;
+    while (btLink.available() && !complete && !rx.failed) {
+      complete = bt_rx_feed(&rx, btLink.read(), filename);
+      lastActivity = hal_millis();
     }
   }
-  
-  if (!messageReceived) {
-    Serial.println(F("Timeout waiting for file transfer"));
-    btTransferActive = false;
-    return;
-  }
-  
-  // Check that the message starts with "START:" and contains "END_TRANSFER"
-  if (!fullMessage.startsWith("START:") || fullMessage.indexOf("END_TRANSFER") == -1) {
-    Serial.println(F("Invalid file format"));
-    btTransferActive = false;
-    return;
-  }
-  
-  // Extract the content between the markers
-  int startIdx = strlen("START:"); // position right after "START:"
-  int endIdx = fullMessage.indexOf("END_TRANSFER");
-  String fileContent = fullMessage.substring(startIdx, endIdx);
-  fileContent.trim();
-  
-  // Debug: Print extracted content
-  Serial.println(F("Extracted file content:"));
-  Serial.println(fileContent);
-  
-  // Define a default filename (alternatively, you could generate a unique name)
-  String filename = "received.txt";
-  Serial.print(F("Saving file as: "));
-  Serial.println(filename);
-  
-  // Check if file already exists
-  if (SD.exists(filename.c_str())) {
-    Serial.println(F("File already exists. Overwriting..."));
-  }
-  
-  // Create the file on the SD card
-  File outputFile = SD.open(filename.c_str(), FILE_WRITE);
-  if (!outputFile) {
-    Serial.println(F("Error creating output file"));
-    btTransferActive = false;
-    return;
+
+  if (rx.file != FS_NO_FILE && !fs_close(rx.file)) rx.failed = true;
+
+  if (complete && !rx.failed) {
+    Serial.print(F("File received and saved successfully ("));
+    Serial.print(rx.received);
+    Serial.print(F(" bytes in "));
+    Serial.print(hal_millis() - startTime);
+    Serial.println(F(" ms)"));
+  } else {
+    if (rx.state == BT_RX_WAIT_START) {
+      Serial.println(F("Timeout waiting for file transfer"));
+    } else {
+      Serial.println(F("Bluetooth transfer failed, partial file removed"));
+      fs_remove(filename != NULL ? filename : (rx.nameLength > 0 ? rx.name : "received.txt"));
+    }
   }
-  
-  // Write content to the file
-  outputFile.print(fileContent);
-  outputFile.close();
-  
-  Serial.println(F("File received and saved successfully"));
   btTransferActive = false;
 }
 
+// Copies the module's answer to the console: waits up to
+// BT_LINK_AT_TIMEOUT for it to start, then until the line goes quiet
+static void bt_echo_reply() {
+  unsigned long start = hal_millis();
+  unsigned long last = 0;
+  bool heard = false;
+  while (heard ? hal_millis() - last < BT_LINK_AT_QUIET : hal_millis() - start < BT_LINK_AT_TIMEOUT) {
+    if (btLink.available()) {
+      Serial.write(btLink.read());
+      last = hal_millis();
+      heard = true;
+    }
+  }
+}
+
 void bt_diagnostic() {
   Serial.println(F("Running Bluetooth diagnostics..."));
   Serial.println(F("Sending test message via Bluetooth"));
   
-  btSerial.println("AT");
-  delay(1000);
-  
+  btLink.println(F("AT"));
   Serial.println(F("Bluetooth module response:"));
-  while (btSerial.available()) {
-    Serial.write(btSerial.read());
-  }
+  bt_echo_reply();
   
-  btSerial.println("AT+VERSION");
-  delay(1000);
-  
-  while (btSerial.available()) {
-    Serial.write(btSerial.read());
-  }
+  btLink.println(F("AT+VERSION"));
+  bt_echo_reply();
+  Serial.println();
   
+  Serial.print(F("Link: "));
+  Serial.print(bt_link_baud());
+  Serial.print(F(" baud | RX overruns: "));
+  Serial.print(btLinkStats.overruns);
+  Serial.print(F(" | framing errors: "));
+  Serial.println(btLinkStats.framingErrors);
   Serial.println(F("Diagnostic complete"));
 }
\ No newline at end of file
@@ -3,11 +3,44 @@
 
 #include <Arduino.h>
 
+// BTSEND framing, one frame:
+//   SOH | seq | len | payload[len] | crc16 (big-endian)
+// CRC-16/CCITT (poly 0x1021, init 0xFFFF) covers seq, len and payload.
+// Frame 0 carries the file size (4 bytes, little-endian) and the name;
+// data frames follow, and an empty frame marks the end of the file.
+// The receiver answers ACK seq (everything up to seq arrived) or NAK seq
+// (resend from seq); CAN aborts. The sender keeps BT_WINDOW frames in
+// flight and goes back to the oldest unacknowledged frame on NAK/timeout.
+// ACKs and NAKs for frames outside the window are stale and ignored; the
+// timeout runs from the last progress, so they do not extend it either.
+#define BT_SOH 0x01
+#define BT_ACK 0x06
+#define BT_NAK 0x15
+#define BT_CAN 0x18
+#define BT_FRAME_PAYLOAD 64
+#define BT_WINDOW 4
+#define BT_ACK_TIMEOUT 1000
+#define BT_MAX_RETRIES 8
+
+// BTGET format: "START:<filename>\n", raw content, "END_TRANSFER".
+// Content is streamed to SD through the fs cache, a line at a time; the
+// end marker is found across line boundaries, and nothing is allocated on
+// the heap.
+#define BT_RX_WAIT_START 0
+#define BT_RX_NAME 1
+#define BT_RX_CONTENT 2
+#define BT_RX_NAME_MAX 12             // 8.3 names
+#define BT_RX_START_TIMEOUT 60000
+#define BT_RX_IDLE_TIMEOUT 5000
+
 extern bool btTransferActive;
 
+uint16_t bt_crc16(uint16_t crc, const uint8_t* data, size_t length);
+
 void bt_init();
 void bt_send_file(const char* filename);
-void bt_receive_file();
+// filename overrides the name in the START header (NULL to use it)
+void bt_receive_file(const char* filename);
 void bt_diagnostic();
 
 #endif
\ No newline at end of file
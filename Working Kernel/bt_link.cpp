@@ -0,0 +1,292 @@
+#include "bt_link.h"
+#include "hal.h"
+#if BT_LINK_BACKEND == BT_LINK_TIMER
+#include <avr/interrupt.h>
+#elif BT_LINK_BACKEND == BT_LINK_SOFTWARE
+#include <SoftwareSerial.h>
+#endif
+
+BtLinkStats btLinkStats = { 0, 0 };
+
+static unsigned long linkBaud = 0;
+
+// AT+BAUDn codes are the table index + 3 (4800 .. 115200)
+static const unsigned long baudRates[] PROGMEM = { 4800, 9600, 19200, 38400, 57600, 115200 };
+#define BAUD_RATE_COUNT (sizeof(baudRates) / sizeof(baudRates[0]))
+#define BAUD_CODE_OFFSET 3
+
+#if BT_LINK_BACKEND == BT_LINK_TIMER
+// Pins 6 and 7 are PD6 / PD7; the RX edge is PCINT22 in the PCINT2 group
+#define RX_MASK _BV(6)
+#define TX_MASK _BV(7)
+
+static_assert((BT_LINK_RX_BUFFER & (BT_LINK_RX_BUFFER - 1)) == 0 && BT_LINK_RX_BUFFER <= 128,
+              "BT_LINK_RX_BUFFER must be a power of two, at most 128");
+static_assert((BT_LINK_TX_BUFFER & (BT_LINK_TX_BUFFER - 1)) == 0 && BT_LINK_TX_BUFFER <= 128,
+              "BT_LINK_TX_BUFFER must be a power of two, at most 128");
+static volatile uint8_t rxBuffer[BT_LINK_RX_BUFFER];
+static volatile uint8_t rxHead = 0;
+static volatile uint8_t rxTail = 0;
+static volatile uint8_t txBuffer[BT_LINK_TX_BUFFER];
+static volatile uint8_t txHead = 0;
+static volatile uint8_t txTail = 0;
+static volatile bool txBusy = false;
+
+// Bit times in 8.8 fixed-point Timer2 ticks (clk/32, 2 us). The high byte
+// of a position wraps together with TCNT2, so it goes straight into OCR2x.
+static uint16_t bitTicks;
+static uint16_t rxPosition;
+static uint16_t txPosition;
+static uint8_t rxBit;
+static uint8_t rxByte;
+static uint8_t txBit;
+static uint8_t txByte;
+
+// Falling edge of a start bit: sample the first data bit 1.5 bits later
+ISR(PCINT2_vect) {
+    if (PIND & RX_MASK) return;
+    PCMSK2 &= ~_BV(PCINT22);
+    rxPosition = ((uint16_t)TCNT2 << 8) + bitTicks + (bitTicks >> 1);
+    OCR2A = rxPosition >> 8;
+    rxBit = 0;
+    TIFR2 = _BV(OCF2A);
+    TIMSK2 |= _BV(OCIE2A);
+}
+
+ISR(TIMER2_COMPA_vect) {
+    bool high = PIND & RX_MASK;
+    if (rxBit < 8) {
+        rxByte = (rxByte >> 1) | (high ? 0x80 : 0);
+        rxBit++;
+        rxPosition += bitTicks;
+        OCR2A = rxPosition >> 8;
+        return;
+    }
+    // Middle of the stop bit: store, then wait for the next start edge
+    if (!high) {
+        btLinkStats.framingErrors++;
+    } else {
+        uint8_t next = (rxHead + 1) & (BT_LINK_RX_BUFFER - 1);
+        if (next == rxTail) {
+            btLinkStats.overruns++;
+        } else {
+            rxBuffer[rxHead] = rxByte;
+            rxHead = next;
+        }
+    }
+    TIMSK2 &= ~_BV(OCIE2A);
+    PCIFR = _BV(PCIF2);
+    PCMSK2 |= _BV(PCINT22);
+}
+
+// One bit per compare: 0 start, 1-8 data (LSB first), 9 stop
+ISR(TIMER2_COMPB_vect) {
+    if (txBit == 0) {
+        if (txHead == txTail) {
+            TIMSK2 &= ~_BV(OCIE2B);
+            txBusy = false;
+            return;
+        }
+        txByte = txBuffer[txTail];
+        txTail = (txTail + 1) & (BT_LINK_TX_BUFFER - 1);
+        PORTD &= ~TX_MASK;
+    } else if (txBit <= 8) {
+        if (txByte & 1) PORTD |= TX_MASK;
+        else PORTD &= ~TX_MASK;
+        txByte >>= 1;
+    } else {
+        PORTD |= TX_MASK;
+    }
+    txBit = (txBit == 9) ? 0 : txBit + 1;
+    txPosition += bitTicks;
+    OCR2B = txPosition >> 8;
+}
+
+class BtTimerUart : public Stream {
+public:
+    void begin(unsigned long baud) {
+        flush();
+        uint8_t sreg = SREG;
+        cli();
+        bitTicks = (uint16_t)(((F_CPU / 32) << 8) / baud);
+        TCCR2A = 0;
+        TCCR2B = _BV(CS21) | _BV(CS20);
+        TIMSK2 &= ~(_BV(OCIE2A) | _BV(OCIE2B));
+        DDRD |= TX_MASK;
+        PORTD |= TX_MASK;
+        DDRD &= ~RX_MASK;
+        PORTD |= RX_MASK;
+        rxHead = rxTail = 0;
+        txHead = txTail = 0;
+        txBusy = false;
+        PCMSK2 |= _BV(PCINT22);
+        PCIFR = _BV(PCIF2);
+        PCICR |= _BV(PCIE2);
+        SREG = sreg;
+    }
+
+    int available() {
+        return (rxHead - rxTail) & (BT_LINK_RX_BUFFER - 1);
+    }
+
+    int read() {
+        if (rxHead == rxTail) return -1;
+        uint8_t c = rxBuffer[rxTail];
+        rxTail = (rxTail + 1) & (BT_LINK_RX_BUFFER - 1);
+        return c;
+    }
+
+    int peek() {
+        return rxHead == rxTail ? -1 : rxBuffer[rxTail];
+    }
+
+    size_t write(uint8_t c) {
+        uint8_t next = (txHead + 1) & (BT_LINK_TX_BUFFER - 1);
+        while (next == txTail) {
+            // Buffer full, the compare ISR is draining it
+        }
+        txBuffer[txHead] = c;
+        txHead = next;
+
+        uint8_t sreg = SREG;
+        cli();
+        if (!txBusy) {
+            txBusy = true;
+            txBit = 0;
+            txPosition = (uint16_t)(TCNT2 + 2) << 8;
+            OCR2B = txPosition >> 8;
+            TIFR2 = _BV(OCF2B);
+            TIMSK2 |= _BV(OCIE2B);
+        }
+        SREG = sreg;
+        return 1;
+    }
+
+    int availableForWrite() {
+        return (txTail - txHead - 1) & (BT_LINK_TX_BUFFER - 1);
+    }
+
+    void flush() {
+        while (txBusy) {
+        }
+    }
+
+    using Print::write;
+};
+
+static BtTimerUart timerUart;
+Stream& btLink = timerUart;
+
+void bt_link_begin(unsigned long baud) {
+    timerUart.begin(baud);
+    linkBaud = baud;
+}
+
+#elif BT_LINK_BACKEND == BT_LINK_HAL
+// The port's serial driver does the work; this only gives it a Stream
+class BtHalLink : public Stream {
+public:
+    int available() { return hal_bt_available(); }
+    int read() { return hal_bt_read(); }
+    int peek() { return hal_bt_peek(); }
+    size_t write(uint8_t c) { return hal_bt_write(c); }
+    int availableForWrite() { return hal_bt_tx_room(); }
+    void flush() {}
+
+    using Print::write;
+};
+
+static BtHalLink halLink;
+Stream& btLink = halLink;
+
+void bt_link_begin(unsigned long baud) {
+    hal_bt_begin(baud);
+    linkBaud = baud;
+}
+
+#elif BT_LINK_BACKEND == BT_LINK_HARDWARE
+Stream& btLink = Serial1;
+
+void bt_link_begin(unsigned long baud) {
+    Serial1.flush();
+    Serial1.begin(baud);
+    linkBaud = baud;
+}
+
+#else
+static SoftwareSerial softSerial(BT_LINK_RX_PIN, BT_LINK_TX_PIN);
+Stream& btLink = softSerial;
+
+void bt_link_begin(unsigned long baud) {
+    softSerial.begin(baud);
+    linkBaud = baud;
+}
+#endif
+
+unsigned long bt_link_baud() {
+    return linkBaud;
+}
+
+// Drops input until the line has been quiet for quietMs
+static void bt_link_discard(unsigned long quietMs) {
+    unsigned long last = hal_millis();
+    while (hal_millis() - last < quietMs) {
+        if (btLink.available()) {
+            btLink.read();
+            last = hal_millis();
+        }
+    }
+}
+
+static bool bt_link_expect_ok(unsigned long timeout) {
+    unsigned long start = hal_millis();
+    char last = 0;
+    while (hal_millis() - start < timeout) {
+        if (!btLink.available()) continue;
+        char c = btLink.read();
+        if (last == 'O' && c == 'K') return true;
+        last = c;
+    }
+    return false;
+}
+
+static bool bt_link_ping() {
+    bt_link_discard(50);
+    btLink.println(F("AT"));
+    bool ok = bt_link_expect_ok(BT_LINK_AT_TIMEOUT);
+    bt_link_discard(50);
+    return ok;
+}
+
+bool bt_link_set_baud(unsigned long baud) {
+    byte code = 0;
+    for (byte i = 0; i < BAUD_RATE_COUNT; i++) {
+        if (pgm_read_dword(&baudRates[i]) == baud) code = i + BAUD_CODE_OFFSET;
+    }
+    if (code == 0 || baud > BT_LINK_MAX_BAUD) return false;
+
+    // The module acknowledges at the old rate, then switches
+    unsigned long previous = linkBaud;
+    bt_link_discard(50);
+    btLink.print(F("AT+BAUD"));
+    btLink.println(code);
+    if (!bt_link_expect_ok(BT_LINK_AT_TIMEOUT)) return false;
+    bt_link_discard(100);
+
+    bt_link_begin(baud);
+    if (bt_link_ping()) return true;
+    bt_link_begin(previous);
+    return false;
+}
+
+bool bt_link_probe() {
+    unsigned long previous = linkBaud;
+    for (byte i = 0; i < BAUD_RATE_COUNT; i++) {
+        unsigned long baud = pgm_read_dword(&baudRates[i]);
+        if (baud > BT_LINK_MAX_BAUD) break;
+        bt_link_begin(baud);
+        if (bt_link_ping()) return true;
+    }
+    bt_link_begin(previous);
+    return false;
+}
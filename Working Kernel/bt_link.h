@@ -0,0 +1,65 @@
+#ifndef BT_LINK_H
+#define BT_LINK_H
+
+#include <Arduino.h>
+#include "kernel_config.h"
+
+// Serial transport for the HC-06. Everything above this module talks to
+// btLink (a Stream); the backend is picked at compile time:
+//   BT_LINK_HARDWARE  Serial1, interrupt-fed core ring buffers (Mega, Leonardo)
+//   BT_LINK_TIMER     UNO: full-duplex software UART on pins 6 (RX) / 7 (TX).
+//                     Start bits are caught by a pin-change interrupt, bits are
+//                     sampled and driven from Timer2 compare A / B, so no ISR
+//                     ever spins for a whole byte. Takes Timer2 (no PWM on 3/11).
+//   BT_LINK_SOFTWARE  SoftwareSerial, for any other Arduino board
+//   BT_LINK_HAL       hal_bt_* of a HAL_EXTERNAL port (hal.h)
+#define BT_LINK_HARDWARE 0
+#define BT_LINK_TIMER 1
+#define BT_LINK_SOFTWARE 2
+#define BT_LINK_HAL 3
+
+#ifndef BT_LINK_BACKEND
+#if defined(HAL_EXTERNAL)
+#define BT_LINK_BACKEND BT_LINK_HAL
+#elif defined(HAVE_HWSERIAL1)
+#define BT_LINK_BACKEND BT_LINK_HARDWARE
+#elif defined(__AVR_ATmega328P__)
+#define BT_LINK_BACKEND BT_LINK_TIMER
+#else
+#define BT_LINK_BACKEND BT_LINK_SOFTWARE
+#endif
+#endif
+
+#if BT_LINK_BACKEND == BT_LINK_HARDWARE || BT_LINK_BACKEND == BT_LINK_HAL
+#define BT_LINK_MAX_BAUD 115200UL
+#else
+#define BT_LINK_MAX_BAUD 38400UL      // keeps bit edges clear of other ISRs' latency
+#endif
+
+#define BT_LINK_RX_PIN 6
+#define BT_LINK_TX_PIN 7
+#define BT_LINK_DEFAULT_BAUD 9600UL   // HC-06 factory setting
+// Ring sizes: BT_LINK_RX_BUFFER and BT_LINK_TX_BUFFER in kernel_config.h
+#define BT_LINK_AT_TIMEOUT 1000
+#define BT_LINK_AT_QUIET 100  // ms of silence that ends an AT reply
+
+// Receive errors seen by the timer UART (always zero on other backends)
+struct BtLinkStats {
+    unsigned int overruns;       // bytes lost to a full RX buffer
+    unsigned int framingErrors;  // missing stop bit
+};
+
+extern Stream& btLink;
+extern BtLinkStats btLinkStats;
+
+void bt_link_begin(unsigned long baud);
+unsigned long bt_link_baud();
+
+// The module only obeys AT commands while no phone/PC is connected.
+// Switches the HC-06 and the local UART to `baud` (AT+BAUDn) and checks the
+// module answers at the new rate.
+bool bt_link_set_baud(unsigned long baud);
+// Tries every supported rate until the module answers "OK" to "AT"
+bool bt_link_probe();
+
+#endif
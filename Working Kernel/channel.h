@@ -0,0 +1,138 @@
+#ifndef CHANNEL_H
+#define CHANNEL_H
+
+#include <Arduino.h>
+#include "coroutine.h"
+#include "events.h"
+#include "hal.h"
+
+// Typed, statically sized links between tasks. Both are used in place:
+// the producer fills the slot reserve() hands out and commit() publishes
+// it; the consumer reads the slot peek() / read() returns and lets it go.
+// Nothing is copied and nothing is allocated.
+//
+// Each side updates only its own index, and an index is one byte, so a
+// single producer and a single consumer need no lock, preemptive mode
+// included. The slots are not volatile, so a compiler barrier keeps their
+// accesses on the right side of each index store. commit() posts the
+// channel's event, so a consumer that subscribes to it can block with
+// CO_WAIT_EVENT(co, !ch.empty(), ms).
+
+// Keeps the compiler from moving memory accesses across it
+#define CHANNEL_BARRIER() asm volatile("" ::: "memory")
+
+// FIFO of up to Capacity - 1 items
+template <typename T, byte Capacity>
+class Channel {
+public:
+    explicit Channel(byte event) : head(0), tail(0), event(event), drops(0) {}
+
+    // Producer: the slot to fill, NULL (and a drop counted) when full
+    T* reserve() {
+        if (next(head) == tail) {
+            drops++;
+            return NULL;
+        }
+        // The slot is written after tail said it is free
+        CHANNEL_BARRIER();
+        return &slots[head];
+    }
+    void commit() {
+        // The slot is written before the consumer can see it
+        CHANNEL_BARRIER();
+        head = next(head);
+        event_signal(event, 0);
+    }
+
+    // Consumer: the oldest item, NULL when empty
+    const T* peek() const {
+        if (empty()) return NULL;
+        // The slot is read after head said it is there
+        CHANNEL_BARRIER();
+        return &slots[tail];
+    }
+    void release() {
+        // The slot is read before the producer can reuse it
+        CHANNEL_BARRIER();
+        tail = next(tail);
+    }
+
+    bool empty() const { return head == tail; }
+    byte count() const { return (byte)(head + Capacity - tail) % Capacity; }
+    unsigned int dropped() const { return drops; }
+
+private:
+    static_assert(Capacity >= 2 && Capacity <= 128, "Channel capacity must be 2..128");
+    static byte next(byte index) { return index + 1 == Capacity ? 0 : index + 1; }
+
+    T slots[Capacity];
+    volatile byte head;  // written by the producer only
+    volatile byte tail;  // written by the consumer only
+    byte event;
+    unsigned int drops;
+};
+
+// Latest value only: the writer never waits, and a commit replaces an
+// item the reader has not taken yet; the reader gets the newest one.
+// Three buffers rotate between the writer, the newest committed item and
+// the reader, and only the rotation runs with interrupts off, so either
+// side may be an ISR or a preempted task. commit() posts the box's event.
+template <typename T>
+class Mailbox {
+public:
+    explicit Mailbox(byte event) : back(0), ready(1), front(2), fresh(false), event(event), overwrites(0) {}
+
+    // Writer: the buffer to fill, always available
+    T* reserve() { return &slots[back]; }
+    void commit() {
+        uint8_t irq = hal_irq_save();
+        byte filled = back;
+        back = ready;
+        ready = filled;
+        if (fresh) overwrites++;
+        fresh = true;
+        // The rotation is done before interrupts can see it
+        CHANNEL_BARRIER();
+        hal_irq_restore(irq);
+        event_signal(event, 0);
+    }
+
+    // Reader: the newest item if one was committed since the last read(),
+    // else NULL. It stays put until the next read().
+    const T* read() {
+        uint8_t irq = hal_irq_save();
+        bool updated = fresh;
+        if (updated) {
+            byte newest = ready;
+            ready = front;
+            front = newest;
+            fresh = false;
+        }
+        CHANNEL_BARRIER();
+        hal_irq_restore(irq);
+        return updated ? &slots[front] : NULL;
+    }
+    bool updated() const { return fresh; }
+    // Items replaced before the reader took them
+    unsigned int overwritten() const { return overwrites; }
+
+private:
+    T slots[3];
+    byte back;   // the writer's
+    byte ready;  // newest committed
+    byte front;  // the reader's
+    volatile bool fresh;
+    byte event;
+    unsigned int overwrites;
+};
+
+// Blocks the task until box has an item newer than its last read, for at
+// most ms; item is then that item, or NULL on timeout. The task has to
+// subscribe to the box's event in its registry entry to be woken by it.
+#define CO_MAILBOX_READ(co, box, item, ms) \
+    do { \
+        CO_WAIT_EVENT_FOR(co, (box).updated(), ms); \
+        (item) = (box).read(); \
+    } while (0)
+
+#endif
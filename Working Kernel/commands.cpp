@@ -0,0 +1,349 @@
+#include "commands.h"
+#include "scheduler.h"
+#include "filesystem.h"
+#include "bluetooth_transfer.h"
+#include "bt_link.h"
+#include "sensor_log.h"
+#include "klog.h"
+#include "task_stats.h"
+#include "bench.h"
+#include "snapshot.h"
+#include "events.h"
+#include "admission.h"
+#include <limits.h>
+
+struct CommandEntry {
+    uint16_t hash;
+    const char* name;      // PROGMEM
+    CommandHandler handler;
+    byte minArgs;          // arguments after the keyword
+    byte maxArgs;
+    byte mode;             // CMD_ANY, CMD_RUNNING or CMD_STOPPED
+    const char* refusal;   // PROGMEM, printed when mode does not hold
+    const char* usage;     // PROGMEM
+};
+
+// Parses a decimal number, rejecting empty strings, trailing garbage and
+// values that do not fit an unsigned long
+static bool parse_ulong(const char* s, unsigned long* value) {
+    if (s == NULL || *s == '\0') return false;
+    unsigned long v = 0;
+    for (; *s; s++) {
+        if (*s < '0' || *s > '9') return false;
+        byte digit = *s - '0';
+        if (v > (ULONG_MAX - digit) / 10) return false;
+        v = v * 10 + digit;
+    }
+    *value = v;
+    return true;
+}
+
+static void cmd_start(byte argc, char** argv) {
+    (void)argc; (void)argv;
+    isPaused = false;
+    Serial.println(F("Scheduler started."));
+}
+
+static void cmd_stop(byte argc, char** argv) {
+    (void)argc; (void)argv;
+    isPaused = true;
+    sensor_log_flush();
+    Serial.println(F("Scheduler stopped."));
+}
+
+static void cmd_exec(byte argc, char** argv) {
+    // Defaults come from the task's registry entry
+    int index = task_registry_find(argv[1]);
+    unsigned long duration = 0;
+    unsigned long priority = 0;
+    bool force = false;
+    if (index >= 0) {
+        duration = pgm_read_word(&taskRegistry[index].period);
+        priority = pgm_read_word(&taskRegistry[index].priority);
+    }
+    for (byte i = 2; i < argc; i += 2) {
+        unsigned long* target;
+        unsigned long limit;
+        if (strcmp_P(argv[i], PSTR("-f")) == 0) {
+            // A flag, takes no value
+            force = true;
+            i--;
+            continue;
+        }
+        if (strcmp_P(argv[i], PSTR("-t")) == 0) {
+            target = &duration;
+            limit = TASK_MAX_PERIOD_MS;
+        } else if (strcmp_P(argv[i], PSTR("-p")) == 0) {
+            target = &priority;
+            limit = TASK_MAX_PRIORITY;
+        } else {
+            Serial.print(F("Unknown option: "));
+            Serial.println(argv[i]);
+            return;
+        }
+        if (i + 1 >= argc || !parse_ulong(argv[i + 1], target) || *target > limit) {
+            Serial.print(F("Missing or invalid value for "));
+            Serial.println(argv[i]);
+            return;
+        }
+    }
+    scheduler_add_task(argv[1], duration, priority, force);
+}
+
+static void cmd_halt(byte argc, char** argv) {
+    (void)argc;
+    scheduler_remove_task(argv[1]);
+}
+
+static void cmd_inspect(byte argc, char** argv) {
+    (void)argc; (void)argv;
+    scheduler_inspect();
+}
+
+static void cmd_stats(byte argc, char** argv) {
+    if (argc == 1) {
+        task_stats_print();
+    } else if (strcmp_P(argv[1], PSTR("reset")) == 0) {
+        task_stats_reset();
+        Serial.println(F("Task stats cleared."));
+    } else if (strcmp_P(argv[1], PSTR("bin")) == 0) {
+        task_stats_dump();
+    } else {
+        Serial.println(F("Usage: stats [reset|bin]"));
+    }
+}
+
+static void cmd_feasibility(byte argc, char** argv) {
+    (void)argc; (void)argv;
+    admission_report();
+}
+
+static void cmd_events(byte argc, char** argv) {
+    if (argc == 1) {
+        events_print();
+    } else if (strcmp_P(argv[1], PSTR("reset")) == 0) {
+        events_reset_stats();
+        Serial.println(F("Event stats cleared."));
+    } else {
+        Serial.println(F("Usage: events [reset]"));
+    }
+}
+
+static void cmd_restore(byte argc, char** argv) {
+    if (argc == 2) {
+        if (strcmp_P(argv[1], PSTR("on")) == 0) {
+            snapshot_set_auto_restore(true);
+        } else if (strcmp_P(argv[1], PSTR("off")) == 0) {
+            snapshot_set_auto_restore(false);
+        } else {
+            Serial.println(F("Usage: restore [on|off]"));
+            return;
+        }
+        // The setting lives in the snapshot so it survives the reset
+        if (!snapshot_save()) Serial.println(F("Snapshot write failed."));
+    }
+    snapshot_print();
+}
+
+static void cmd_create(byte argc, char** argv) {
+    (void)argc;
+    createFile(argv[1]);
+}
+
+static void cmd_delete(byte argc, char** argv) {
+    (void)argc;
+    deleteFile(argv[1]);
+}
+
+static void cmd_view(byte argc, char** argv) {
+    (void)argc; (void)argv;
+    listFiles();
+}
+
+static void cmd_logcsv(byte argc, char** argv) {
+    (void)argc; (void)argv;
+    sensor_log_export_csv();
+}
+
+static void cmd_btget(byte argc, char** argv) {
+    bt_receive_file(argc > 1 ? argv[1] : NULL);
+}
+
+static void cmd_btsend(byte argc, char** argv) {
+    (void)argc;
+    bt_send_file(argv[1]);
+}
+
+static void cmd_btdiag(byte argc, char** argv) {
+    (void)argc; (void)argv;
+    bt_diagnostic();
+}
+
+static void cmd_btbaud(byte argc, char** argv) {
+    bool ok;
+    if (argc == 2) {
+        unsigned long baud;
+        if (!parse_ulong(argv[1], &baud)) {
+            Serial.println(F("Invalid baud rate."));
+            return;
+        }
+        ok = bt_link_set_baud(baud);
+    } else {
+        ok = bt_link_probe();
+    }
+    if (!ok) {
+        Serial.print(F("Module did not answer (connected, or rate unsupported; max "));
+        Serial.print(BT_LINK_MAX_BAUD);
+        Serial.println(F(")."));
+    }
+    Serial.print(F("Bluetooth link: "));
+    Serial.print(bt_link_baud());
+    Serial.println(F(" baud"));
+}
+
+#if KERNEL_BENCHMARK
+static void cmd_bench(byte argc, char** argv) {
+    (void)argc; (void)argv;
+    bench_run();
+}
+#endif
+
+static void cmd_loglevel(byte argc, char** argv) {
+    if (argc == 2) {
+        unsigned long level;
+        if (!parse_ulong(argv[1], &level) || level > KLOG_DEBUG) {
+            Serial.println(F("Log level must be 0 (error) to 3 (debug)."));
+            return;
+        }
+        klogLevel = level;
+    }
+    Serial.print(F("Log level: "));
+    Serial.print(klogLevel);
+    Serial.print(F(" | dropped: "));
+    Serial.println(klogDropped);
+}
+
+static const char nameStart[] PROGMEM = "start";
+static const char nameStop[] PROGMEM = "stop";
+static const char nameExec[] PROGMEM = "exec";
+static const char nameHalt[] PROGMEM = "halt";
+static const char nameInspect[] PROGMEM = "inspect";
+static const char nameStats[] PROGMEM = "stats";
+static const char nameFeasibility[] PROGMEM = "feasibility";
+static const char nameEvents[] PROGMEM = "events";
+static const char nameRestore[] PROGMEM = "restore";
+static const char nameCreate[] PROGMEM = "CREATE";
+static const char nameDelete[] PROGMEM = "DELETE";
+static const char nameView[] PROGMEM = "VIEW";
+static const char nameLogCsv[] PROGMEM = "LOGCSV";
+static const char nameBtGet[] PROGMEM = "BTGET";
+static const char nameBtSend[] PROGMEM = "BTSEND";
+static const char nameBtDiag[] PROGMEM = "BTDIAG";
+static const char nameBtBaud[] PROGMEM = "BTBAUD";
+#if KERNEL_BENCHMARK
+static const char nameBench[] PROGMEM = "bench";
+#endif
+static const char nameLogLevel[] PROGMEM = "loglevel";
+
+static const char usageNone[] PROGMEM = "";
+static const char usageExec[] PROGMEM = "exec <task> [-t period] [-p priority] [-f]";
+static const char usageHalt[] PROGMEM = "halt <task>";
+static const char usageStats[] PROGMEM = "stats [reset|bin]";
+static const char usageEvents[] PROGMEM = "events [reset]";
+static const char usageRestore[] PROGMEM = "restore [on|off]";
+static const char usageCreate[] PROGMEM = "CREATE <filename>";
+static const char usageDelete[] PROGMEM = "DELETE <filename>";
+static const char usageBtGet[] PROGMEM = "BTGET [filename]";
+static const char usageBtSend[] PROGMEM = "BTSEND <filename>";
+static const char usageBtBaud[] PROGMEM = "BTBAUD [4800-115200]";
+static const char usageLogLevel[] PROGMEM = "loglevel [0-3]";
+
+static const char refuseStopped[] PROGMEM = "Scheduler is stopped. Use 'start' to run the scheduler.";
+static const char refuseFileOps[] PROGMEM = "Scheduler is running. Use 'stop' before file operations.";
+static const char refuseBtFile[] PROGMEM = "Stop the scheduler before Bluetooth file operations.";
+#if KERNEL_BENCHMARK
+static const char refuseBench[] PROGMEM = "Stop the scheduler before running the benchmark.";
+#endif
+static const char refuseBtDiag[] PROGMEM = "Stop the scheduler before Bluetooth diagnostics.";
+
+// Adding a command is one row here; lookup compares hashes, not strings
+static const CommandEntry commandTable[] PROGMEM = {
+    { command_hash("start"),   nameStart,   cmd_start,   0, 0, CMD_ANY,     NULL,          usageNone },
+    { command_hash("stop"),    nameStop,    cmd_stop,    0, 0, CMD_ANY,     NULL,          usageNone },
+    { command_hash("exec"),    nameExec,    cmd_exec,    1, 6, CMD_RUNNING, refuseStopped, usageExec },
+    { command_hash("halt"),    nameHalt,    cmd_halt,    1, 1, CMD_RUNNING, refuseStopped, usageHalt },
+    { command_hash("inspect"), nameInspect, cmd_inspect, 0, 0, CMD_ANY,     NULL,          usageNone },
+    { command_hash("stats"),   nameStats,   cmd_stats,   0, 1, CMD_ANY,     NULL,          usageStats },
+    { command_hash("feasibility"), nameFeasibility, cmd_feasibility, 0, 0, CMD_ANY, NULL,      usageNone },
+    { command_hash("events"),  nameEvents,  cmd_events,  0, 1, CMD_ANY,     NULL,          usageEvents },
+    { command_hash("restore"), nameRestore, cmd_restore, 0, 1, CMD_ANY,     NULL,          usageRestore },
+    { command_hash("CREATE"),  nameCreate,  cmd_create,  1, 1, CMD_STOPPED, refuseFileOps, usageCreate },
+    { command_hash("DELETE"),  nameDelete,  cmd_delete,  1, 1, CMD_STOPPED, refuseFileOps, usageDelete },
+    { command_hash("VIEW"),    nameView,    cmd_view,    0, 0, CMD_ANY,     NULL,          usageNone },
+    { command_hash("LOGCSV"),  nameLogCsv,  cmd_logcsv,  0, 0, CMD_STOPPED, refuseFileOps, usageNone },
+    { command_hash("BTGET"),   nameBtGet,   cmd_btget,   0, 1, CMD_STOPPED, refuseBtFile,  usageBtGet },
+    { command_hash("BTSEND"),  nameBtSend,  cmd_btsend,  1, 1, CMD_STOPPED, refuseBtFile,  usageBtSend },
+    { command_hash("BTDIAG"),  nameBtDiag,  cmd_btdiag,  0, 0, CMD_STOPPED, refuseBtDiag,  usageNone },
+    { command_hash("BTBAUD"),  nameBtBaud,  cmd_btbaud,  0, 1, CMD_STOPPED, refuseBtDiag,  usageBtBaud },
+#if KERNEL_BENCHMARK
+    { command_hash("bench"),   nameBench,   cmd_bench,   0, 0, CMD_STOPPED, refuseBench,   usageNone },
+#endif
+    { command_hash("loglevel"), nameLogLevel, cmd_loglevel, 0, 1, CMD_ANY,   NULL,          usageLogLevel },
+};
+
+#define COMMAND_COUNT (sizeof(commandTable) / sizeof(commandTable[0]))
+
+// Splits on whitespace by writing terminators into the line, no copies
+static byte tokenize(char* line, char** argv) {
+    byte argc = 0;
+    while (*line) {
+        while (*line == ' ' || *line == '\t' || *line == '\r') *line++ = '\0';
+        if (*line == '\0') break;
+        if (argc == CMD_MAX_ARGS) return CMD_MAX_ARGS + 1;  // too many
+        argv[argc++] = line;
+        while (*line && *line != ' ' && *line != '\t' && *line != '\r') line++;
+    }
+    return argc;
+}
+
+uint16_t command_hash_token(const char* s) {
+    uint16_t h = 5381;
+    while (*s) h = h * 33 + (byte)*s++;
+    return h;
+}
+
+static void print_progmem(const char* s) {
+    Serial.println(reinterpret_cast<const __FlashStringHelper*>(s));
+}
+
+void command_execute(char* line) {
+    char* argv[CMD_MAX_ARGS];
+    byte argc = tokenize(line, argv);
+    if (argc == 0) return;
+    if (argc > CMD_MAX_ARGS) {
+        Serial.println(F("Too many arguments."));
+        return;
+    }
+
+    uint16_t hash = command_hash_token(argv[0]);
+    for (byte i = 0; i < COMMAND_COUNT; i++) {
+        if (pgm_read_word(&commandTable[i].hash) != hash) continue;
+        CommandEntry entry;
+        memcpy_P(&entry, &commandTable[i], sizeof(entry));
+        if (strcmp_P(argv[0], entry.name) != 0) continue;
+
+        if ((entry.mode == CMD_RUNNING && !isSchedulerRunning()) ||
+            (entry.mode == CMD_STOPPED && isSchedulerRunning())) {
+            print_progmem(entry.refusal);
+            return;
+        }
+        if (argc - 1 < entry.minArgs || argc - 1 > entry.maxArgs) {
+            Serial.print(F("Usage: "));
+            print_progmem(entry.usage);
+            return;
+        }
+        entry.handler(argc, argv);
+        return;
+    }
+    Serial.println(F("Invalid command!"));
+}
@@ -0,0 +1,25 @@
+#ifndef COMMANDS_H
+#define COMMANDS_H
+
+#include <Arduino.h>
+
+#define CMD_MAX_ARGS 8
+
+// Where a command may run
+#define CMD_ANY 0
+#define CMD_RUNNING 1  // scheduler must be running
+#define CMD_STOPPED 2  // scheduler must be stopped
+
+typedef void (*CommandHandler)(byte argc, char** argv);
+
+// Keyword hash used for table lookup, evaluated at compile time for the table
+constexpr uint16_t command_hash(const char* s, uint16_t h = 5381) {
+    return *s ? command_hash(s + 1, (uint16_t)(h * 33 + (byte)*s)) : h;
+}
+// Same hash for a string only known at run time
+uint16_t command_hash_token(const char* s);
+
+// Tokenizes the line in place and runs the matching command
+void command_execute(char* line);
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef COROUTINE_H
+#define COROUTINE_H
+
+#include <Arduino.h>
+#include "hal.h"
+
+// Stackless (protothread-style) tasks. The body sits between CO_BEGIN and
+// CO_END and returns to the scheduler at every CO_* primitive; the next
+// dispatch resumes right after it. Locals do not survive a resume, keep
+// state in statics as led_task_wrapper() does. Do not use switch inside.
+
+// Status returned to the scheduler
+#define CO_YIELDED 0   // ready again once other ready tasks had a turn
+#define CO_WAITING 1   // blocked, condition rechecked every CO_POLL_INTERVAL ms
+#define CO_SLEEPING 2  // blocked until wakeAt
+#define CO_ENDED 3     // job finished, restarts from the top at the next release
+#define CO_EVENT 4     // blocked until a subscribed event (events.h) or wakeAt
+
+#define CO_POLL_INTERVAL 1
+
+// Marks the deliberate fall into a resume label, for -Wimplicit-fallthrough
+#if defined(__has_attribute)
+#if __has_attribute(fallthrough)
+#define CO_FALLTHROUGH __attribute__((fallthrough))
+#endif
+#endif
+#ifndef CO_FALLTHROUGH
+#define CO_FALLTHROUGH
+#endif
+
+struct Coroutine {
+    uint16_t resume;       // line to continue from, 0 = top
+    unsigned long wakeAt;  // earliest time the task may run again
+};
+
+typedef uint8_t (*CoroutineFunction)(Coroutine* co);
+
+#define CO_BEGIN(co) switch ((co)->resume) { case 0:
+
+#define CO_END(co) } (co)->resume = 0; return CO_ENDED
+
+#define CO_YIELD(co) \
+    do { (co)->resume = __LINE__; return CO_YIELDED; case __LINE__:; } while (0)
+
+#define CO_WAIT_UNTIL(co, cond) \
+    do { (co)->resume = __LINE__; CO_FALLTHROUGH; case __LINE__: if (!(cond)) return CO_WAITING; } while (0)
+
+// Like CO_WAIT_UNTIL, but cond is only rechecked when one of the task's
+// subscribed events arrives, or after ms as a fallback
+#define CO_WAIT_EVENT(co, cond, ms) \
+    do { \
+        (co)->resume = __LINE__; \
+        CO_FALLTHROUGH; \
+        case __LINE__: \
+        if (!(cond)) { \
+            (co)->wakeAt = hal_millis() + (ms); \
+            return CO_EVENT; \
+        } \
+    } while (0)
+
+// Like CO_WAIT_EVENT, but gives up after ms and continues with cond
+// still false: a receive with a timeout
+#define CO_WAIT_EVENT_FOR(co, cond, ms) \
+    do { \
+        (co)->wakeAt = hal_millis() + (ms); \
+        (co)->resume = __LINE__; \
+        CO_FALLTHROUGH; \
+        case __LINE__: \
+        if (!(cond) && (long)(hal_millis() - (co)->wakeAt) < 0) return CO_EVENT; \
+    } while (0)
+
+#define CO_SLEEP_FOR(co, ms) \
+    do { \
+        (co)->wakeAt = hal_millis() + (ms); \
+        (co)->resume = __LINE__; \
+        CO_FALLTHROUGH; \
+        case __LINE__: \
+        if ((long)(hal_millis() - (co)->wakeAt) < 0) return CO_SLEEPING; \
+    } while (0)
+
+#endif
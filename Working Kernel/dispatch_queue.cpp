@@ -0,0 +1,170 @@
+#include "dispatch_queue.h"
+#include "scheduler.h"
+
+typedef bool (*HeapOrder)(byte a, byte b);
+
+template <byte Capacity>
+struct TaskHeap {
+    byte items[Capacity];
+    byte size;
+    HeapOrder before;
+};
+
+// millis() wraps, so compare times by signed difference
+static bool time_before(unsigned long a, unsigned long b) {
+    return (long)(a - b) < 0;
+}
+
+// A coroutine in the middle of a job becomes ready at co.wakeAt, not at its release
+static unsigned long ready_time(byte index) {
+    const ScheduledTask* task = &taskList[index];
+    if (task->co.resume != 0) {
+        return task->co.wakeAt;
+    }
+    return task->startTime;
+}
+
+static bool release_before(byte a, byte b) {
+    unsigned long readyA = ready_time(a);
+    unsigned long readyB = ready_time(b);
+    if (readyA != readyB) {
+        return time_before(readyA, readyB);
+    }
+    return taskList[a].priority > taskList[b].priority;
+}
+
+static bool ready_before(byte a, byte b) {
+    // Period 0 is background work, behind every periodic task; admission
+    // control does not analyse it, so it must not take their time
+    bool backgroundA = taskList[a].period == 0;
+    bool backgroundB = taskList[b].period == 0;
+    if (backgroundA != backgroundB) {
+        return backgroundB;
+    }
+#if SCHED_POLICY == SCHED_EDF
+    unsigned long deadlineA = task_deadline(&taskList[a]);
+    unsigned long deadlineB = task_deadline(&taskList[b]);
+    if (deadlineA != deadlineB) {
+        return time_before(deadlineA, deadlineB);
+    }
+    return taskList[a].priority > taskList[b].priority;
+#else
+    if (taskList[a].priority != taskList[b].priority) {
+        return taskList[a].priority > taskList[b].priority;
+    }
+    return time_before(ready_time(a), ready_time(b));
+#endif
+}
+
+// Every task can be admitted at once, so both heaps hold the whole registry
+static TaskHeap<TASK_COUNT> releaseHeap;
+static TaskHeap<TASK_COUNT> readyHeap;
+
+template <byte Capacity>
+static void heap_sift_up(TaskHeap<Capacity>* heap, byte pos) {
+    byte item = heap->items[pos];
+    while (pos > 0) {
+        byte parent = (pos - 1) / 2;
+        if (!heap->before(item, heap->items[parent])) break;
+        heap->items[pos] = heap->items[parent];
+        pos = parent;
+    }
+    heap->items[pos] = item;
+}
+
+template <byte Capacity>
+static void heap_sift_down(TaskHeap<Capacity>* heap, byte pos) {
+    byte item = heap->items[pos];
+    for (;;) {
+        byte child = 2 * pos + 1;
+        if (child >= heap->size) break;
+        if (child + 1 < heap->size && heap->before(heap->items[child + 1], heap->items[child])) {
+            child++;
+        }
+        if (!heap->before(heap->items[child], item)) break;
+        heap->items[pos] = heap->items[child];
+        pos = child;
+    }
+    heap->items[pos] = item;
+}
+
+template <byte Capacity>
+static void heap_push(TaskHeap<Capacity>* heap, byte item) {
+    heap->items[heap->size] = item;
+    heap_sift_up(heap, heap->size++);
+}
+
+template <byte Capacity>
+static byte heap_pop(TaskHeap<Capacity>* heap) {
+    byte top = heap->items[0];
+    heap->items[0] = heap->items[--heap->size];
+    if (heap->size > 0) heap_sift_down(heap, 0);
+    return top;
+}
+
+template <byte Capacity>
+static bool heap_remove(TaskHeap<Capacity>* heap, byte item) {
+    for (byte pos = 0; pos < heap->size; pos++) {
+        if (heap->items[pos] != item) continue;
+        heap->items[pos] = heap->items[--heap->size];
+        if (pos < heap->size) {
+            heap_sift_up(heap, pos);
+            heap_sift_down(heap, pos);
+        }
+        return true;
+    }
+    return false;
+}
+
+void dispatch_init() {
+    releaseHeap.size = 0;
+    releaseHeap.before = release_before;
+    readyHeap.size = 0;
+    readyHeap.before = ready_before;
+}
+
+void dispatch_insert(int index) {
+    heap_push(&releaseHeap, index);
+}
+
+void dispatch_remove(int index) {
+    if (!heap_remove(&readyHeap, index)) {
+        heap_remove(&releaseHeap, index);
+    }
+}
+
+int dispatch_next(unsigned long now) {
+    while (releaseHeap.size > 0 && !time_before(now, ready_time(releaseHeap.items[0]))) {
+        heap_push(&readyHeap, heap_pop(&releaseHeap));
+    }
+    if (readyHeap.size == 0) return -1;
+    return heap_pop(&readyHeap);
+}
+
+bool dispatch_next_release(unsigned long* release) {
+    if (readyHeap.size > 0) {
+        *release = ready_time(readyHeap.items[0]);
+        return true;
+    }
+    if (releaseHeap.size > 0) {
+        *release = ready_time(releaseHeap.items[0]);
+        return true;
+    }
+    return false;
+}
+
+// Called from the tick, so it only reads the heaps. The ready heap's top
+// is its best task; due tasks still in the release heap are checked one by one.
+static bool outranks(byte item, byte current, bool sliceOver) {
+    if (ready_before(item, current)) return true;
+    return sliceOver && !ready_before(current, item);
+}
+
+bool dispatch_preempts(int current, unsigned long now, bool sliceOver) {
+    if (readyHeap.size > 0 && outranks(readyHeap.items[0], current, sliceOver)) return true;
+    for (byte pos = 0; pos < releaseHeap.size; pos++) {
+        byte item = releaseHeap.items[pos];
+        if (!time_before(now, ready_time(item)) && outranks(item, current, sliceOver)) return true;
+    }
+    return false;
+}
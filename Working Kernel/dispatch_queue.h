@@ -0,0 +1,22 @@
+#ifndef DISPATCH_QUEUE_H
+#define DISPATCH_QUEUE_H
+
+#include <Arduino.h>
+
+// Admitted tasks (active or swapped) wait in a release heap keyed on
+// startTime (co.wakeAt for a blocked coroutine); once released they move
+// to a ready heap ordered by SCHED_POLICY. Tasks with period 0 rank
+// behind every periodic task, among themselves by the same policy.
+
+void dispatch_init();
+void dispatch_insert(int index);
+void dispatch_remove(int index);
+// Releases every due task and pops the best ready one, -1 if none is ready
+int dispatch_next(unsigned long now);
+// Earliest time a task is (or becomes) ready, false if nothing is admitted
+bool dispatch_next_release(unsigned long* release);
+// True if a task ready at now should take the CPU from the running one:
+// it ranks ahead, or sliceOver is set and it ranks no lower
+bool dispatch_preempts(int current, unsigned long now, bool sliceOver);
+
+#endif
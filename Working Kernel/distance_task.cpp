@@ -1,37 +1,63 @@
 #include "distance_task.h"
+#include "ranging.h"
+#include "klog.h"
+#include "hal.h"
 #include <Arduino.h>
-#include <SD.h>
 
 const int trigPin = 9;
 const int echoPin = 8;
 
+// Median over the last few valid echoes rejects single-shot outliers
+#define DISTANCE_FILTER_SIZE 5
+
+Channel<DistanceSample, DISTANCE_CHANNEL_SIZE> distanceReadings(EVENT_DISTANCE);
+
+static unsigned int echoWindow[DISTANCE_FILTER_SIZE];
+static byte echoCount = 0;
+static byte echoNext = 0;
+
+static unsigned int filter_echo(unsigned int echoUs) {
+    echoWindow[echoNext] = echoUs;
+    echoNext = (echoNext + 1) % DISTANCE_FILTER_SIZE;
+    if (echoCount < DISTANCE_FILTER_SIZE) echoCount++;
+
+    unsigned int sorted[DISTANCE_FILTER_SIZE];
+    for (byte i = 0; i < echoCount; i++) {
+        // Insertion sort, the window is tiny
+        byte j = i;
+        while (j > 0 && sorted[j - 1] > echoWindow[i]) {
+            sorted[j] = sorted[j - 1];
+            j--;
+        }
+        sorted[j] = echoWindow[i];
+    }
+    return sorted[echoCount / 2];
+}
+
 void setup_distance_sensor() {
-    pinMode(trigPin, OUTPUT);
-    pinMode(echoPin, INPUT);
+    ranging_begin(trigPin, echoPin);
 }
 
-void distance_task_wrapper() {
-    // Measure distance
-    digitalWrite(trigPin, LOW);
-    delayMicroseconds(2);
-    digitalWrite(trigPin, HIGH);
-    delayMicroseconds(10);
-    digitalWrite(trigPin, LOW);
-
-    long duration = pulseIn(echoPin, HIGH);
-    int distance = duration * 0.034 / 2;
-
-    // Log to Serial
-    Serial.print(F("Distance: "));
-    Serial.print(distance);
-    Serial.println(F(" cm"));
-
-    // Log to SD Card
-    File dataFile = SD.open("distance_log.txt", FILE_WRITE);
-    if (dataFile) {
-        dataFile.print(millis());
-        dataFile.print(F(","));
-        dataFile.println(distance);
-        dataFile.close();
+uint8_t distance_task_wrapper(Coroutine* co) {
+    CO_BEGIN(co);
+    // Measure distance without blocking: the echo is timed by the ISR,
+    // which posts EVENT_ECHO; the fallback recheck catches the timeout
+    ranging_trigger();
+    CO_WAIT_EVENT(co, ranging_done(), RANGING_TIMEOUT_US / 1000 + 1);
+
+    if (ranging_echo_us() != 0) {
+        int distance = ranging_us_to_cm(filter_echo(ranging_echo_us()));
+
+        // Log to Serial, formatted later by klog_drain()
+        klog_value(KLOG_DISTANCE, distance);
+
+        // The SD card is the logger task's job; a full channel drops the sample
+        DistanceSample* sample = distanceReadings.reserve();
+        if (sample != NULL) {
+            sample->at = hal_millis();
+            sample->cm = distance;
+            distanceReadings.commit();
+        }
     }
-}
\ No newline at end of file
+    CO_END(co);
+}
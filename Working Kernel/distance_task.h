@@ -1,7 +1,24 @@
 #ifndef DISTANCE_TASK_H
 #define DISTANCE_TASK_H
 
+#include "coroutine.h"
+#include "channel.h"
+#include "kernel_config.h"
+
+// One filtered reading, handed to the logger task
+struct DistanceSample {
+    unsigned long at;  // millis() when it was measured
+    uint16_t cm;
+};
+
+// DISTANCE_CHANNEL_SIZE is in kernel_config.h
+extern Channel<DistanceSample, DISTANCE_CHANNEL_SIZE> distanceReadings;
+
 void setup_distance_sensor();
-void distance_task_wrapper();
+uint8_t distance_task_wrapper(Coroutine* co);
+
+// Registry entry (task_registry.h): name, function, coroutine, period ms, priority, events, stack.
+// Each step returns within microseconds, so it runs on the loop's stack.
+#define DISTANCE_TASK(X) X("distance", NULL, distance_task_wrapper, 3000, 10, EVENT_BIT(EVENT_ECHO), 0)
 
-#endif
\ No newline at end of file
+#endif
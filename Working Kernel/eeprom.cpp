@@ -1,23 +1,66 @@
 #include "eeprom.h"
 
+// Set after a write is issued; the next access polls for the ACK first
+// so the write cycle overlaps with whatever the caller does in between.
+static bool writePending = false;
+
+bool waitEEPROMReady() {
+    if (!writePending) return true;
+    unsigned long start = hal_millis();
+    do {
+        // The device NACKs its address while an internal write cycle is running
+        if (hal_i2c_probe(EEPROM_ADDRESS)) {
+            writePending = false;
+            return true;
+        }
+    } while (hal_millis() - start < EEPROM_WRITE_TIMEOUT);
+    return false;
+}
+
 void writeEEPROM(unsigned int address, byte data) {
-    Wire.beginTransmission(EEPROM_ADDRESS);
-    Wire.write((int)(address >> 8));    // MSB of address
-    Wire.write((int)(address & 0xFF));    // LSB of address
-    Wire.write(data);
-    Wire.endTransmission();
-    delay(5);  // Allow time for write cycle to complete
+    writeEEPROMBlock(address, &data, 1);
 }
 
 byte readEEPROM(unsigned int address) {
-    Wire.beginTransmission(EEPROM_ADDRESS);
-    Wire.write((int)(address >> 8));    // MSB of address
-    Wire.write((int)(address & 0xFF));    // LSB of address
-    Wire.endTransmission();
-    
-    Wire.requestFrom(EEPROM_ADDRESS, 1);
-    if (Wire.available()) {
-        return Wire.read();
+    byte data;
+    if (!readEEPROMBlock(address, &data, 1)) {
+        return 0xFF;
+    }
+    return data;
+}
+
+bool writeEEPROMBlock(unsigned int address, const byte* data, unsigned int length) {
+    while (length > 0) {
+        // Never cross a page boundary or overflow the I2C buffer
+        unsigned int chunk = EEPROM_PAGE_SIZE - (address % EEPROM_PAGE_SIZE);
+        if (chunk > EEPROM_WIRE_CHUNK) chunk = EEPROM_WIRE_CHUNK;
+        if (chunk > length) chunk = length;
+
+        if (!waitEEPROMReady()) return false;
+        byte head[2] = { (byte)(address >> 8), (byte)(address & 0xFF) };  // MSB, LSB of address
+        if (!hal_i2c_write(EEPROM_ADDRESS, head, 2, data, chunk, true)) return false;
+        writePending = true;
+
+        address += chunk;
+        data += chunk;
+        length -= chunk;
+    }
+    return true;
+}
+
+bool readEEPROMBlock(unsigned int address, byte* data, unsigned int length) {
+    if (!waitEEPROMReady()) return false;
+    while (length > 0) {
+        // Sequential reads roll over page boundaries, only the I2C buffer limits the size
+        unsigned int chunk = length > EEPROM_READ_CHUNK ? EEPROM_READ_CHUNK : length;
+
+        byte head[2] = { (byte)(address >> 8), (byte)(address & 0xFF) };  // MSB, LSB of address
+        if (!hal_i2c_write(EEPROM_ADDRESS, head, 2, NULL, 0, false)) return false;  // repeated start
+        if (!hal_i2c_read(EEPROM_ADDRESS, data, chunk)) return false;
+
+        address += chunk;
+        data += chunk;
+        length -= chunk;
     }
-    return 0xFF;
+    return true;
 }
@@ -2,11 +2,30 @@
 #define EEPROM_H
 
 #include <Arduino.h>
-#include <Wire.h>
+#include "hal.h"
 
 #define EEPROM_ADDRESS 0x50  // I2C address for the EEPROM
+#define EEPROM_SIZE 32768    // 24LC256
+#define EEPROM_PAGE_SIZE 64  // Writes must not cross a page boundary (32 on 24LC32/64)
+#define EEPROM_WRITE_TIMEOUT 20  // ms to wait for a write cycle (tWC is 5 ms max)
+
+// Map: the swap log starts at 0, the scheduler snapshot takes the top
+// EEPROM_SNAPSHOT_SIZE bytes (two slots, see snapshot.h). Ports with
+// 64-bit longs and pointers need 1024 to fit the task table.
+#ifndef EEPROM_SNAPSHOT_SIZE
+#define EEPROM_SNAPSHOT_SIZE 512
+#endif
+
+// The I2C transmit buffer also has to hold the two address bytes
+#define EEPROM_WIRE_CHUNK (HAL_I2C_MAX_WRITE - 2)
+#define EEPROM_READ_CHUNK HAL_I2C_MAX_READ
 
 void writeEEPROM(unsigned int address, byte data);
 byte readEEPROM(unsigned int address);
 
+// Block API: page-split writes and sequential reads, ACK polling instead of fixed delays
+bool writeEEPROMBlock(unsigned int address, const byte* data, unsigned int length);
+bool readEEPROMBlock(unsigned int address, byte* data, unsigned int length);
+bool waitEEPROMReady();
+
 #endif
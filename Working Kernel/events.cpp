@@ -0,0 +1,143 @@
+#include "events.h"
+#include "scheduler.h"
+#include "dispatch_queue.h"
+#include "hal.h"
+
+#define EVENT_RING_MASK (EVENT_RING - 1)
+static_assert((EVENT_RING & EVENT_RING_MASK) == 0, "EVENT_RING must be a power of two");
+static_assert(EVENT_COUNT <= 8, "subscription masks are one byte");
+
+EventStats eventStats;
+
+static KernelEvent ring[EVENT_RING];
+static volatile byte ringHead = 0;  // written by the producer only
+static volatile byte ringTail = 0;  // written by the consumer only
+
+// Producer-side counters, read with interrupts off
+static volatile unsigned long posted = 0;
+static volatile unsigned int dropped = 0;
+static volatile byte highWater = 0;
+
+static bool blocked[TASK_COUNT];
+
+void events_init() {
+    ringHead = 0;
+    ringTail = 0;
+    memset(blocked, 0, sizeof(blocked));
+    events_reset_stats();
+}
+
+void event_post(byte id, byte arg) {
+    byte head = ringHead;
+    byte next = (head + 1) & EVENT_RING_MASK;
+    if (next == ringTail) {
+        dropped++;
+        return;
+    }
+    ring[head].id = id;
+    ring[head].arg = arg;
+    ring[head].stamp = hal_micros();
+    // Publish only after the record is complete
+    ringHead = next;
+    posted++;
+    byte depth = (next - ringTail) & EVENT_RING_MASK;
+    if (depth > highWater) highWater = depth;
+}
+
+void event_signal(byte id, byte arg) {
+    uint8_t state = hal_irq_save();
+    event_post(id, arg);
+    hal_irq_restore(state);
+}
+
+bool events_pending() {
+    return ringHead != ringTail;
+}
+
+static void deliver(const KernelEvent* event, unsigned long now) {
+    uint16_t latency = (uint16_t)hal_micros() - event->stamp;
+    eventStats.delivered++;
+    eventStats.latencyTotalUs += latency;
+    if (latency > eventStats.latencyMaxUs) eventStats.latencyMaxUs = latency;
+
+    byte bit = EVENT_BIT(event->id);
+    for (int i = 0; i < TASK_COUNT; i++) {
+        if (!blocked[i] || !(pgm_read_byte(&taskRegistry[i].events) & bit)) continue;
+        // Only a queued task can be re-keyed
+        if (!taskList[i].active && !taskList[i].swapped) {
+            blocked[i] = false;
+            continue;
+        }
+        // Re-key it so it is released now instead of at its recheck time
+        blocked[i] = false;
+        dispatch_remove(i);
+        taskList[i].co.wakeAt = now;
+        dispatch_insert(i);
+        eventStats.wakeups++;
+    }
+}
+
+void events_dispatch() {
+    unsigned long now = hal_millis();
+    while (ringTail != ringHead) {
+        byte tail = ringTail;
+        KernelEvent event = ring[tail];
+        // Free the slot only after it is copied
+        ringTail = (tail + 1) & EVENT_RING_MASK;
+        deliver(&event, now);
+    }
+}
+
+void events_block(int index) {
+    blocked[index] = true;
+}
+
+void events_unblock(int index) {
+    blocked[index] = false;
+}
+
+void events_reset_stats() {
+    memset(&eventStats, 0, sizeof(eventStats));
+    uint8_t irq = hal_irq_save();
+    posted = 0;
+    dropped = 0;
+    highWater = 0;
+    hal_irq_restore(irq);
+}
+
+void events_print() {
+    uint8_t irq = hal_irq_save();
+    unsigned long postedCopy = posted;
+    unsigned int droppedCopy = dropped;
+    byte highWaterCopy = highWater;
+    byte depth = (ringHead - ringTail) & EVENT_RING_MASK;
+    hal_irq_restore(irq);
+
+    Serial.print(F("Events posted: "));
+    Serial.print(postedCopy);
+    Serial.print(F(" | delivered: "));
+    Serial.print(eventStats.delivered);
+    Serial.print(F(" | dropped: "));
+    Serial.print(droppedCopy);
+    Serial.print(F(" | queued: "));
+    Serial.print(depth);
+    Serial.print(F(" (max "));
+    Serial.print(highWaterCopy);
+    Serial.print('/');
+    Serial.print(EVENT_RING - 1);
+    Serial.println(')');
+    Serial.print(F("Wakeups: "));
+    Serial.print(eventStats.wakeups);
+    if (eventStats.delivered > 0) {
+        Serial.print(F(" | latency us avg/max: "));
+        Serial.print(eventStats.latencyTotalUs / eventStats.delivered);
+        Serial.print('/');
+        Serial.print(eventStats.latencyMaxUs);
+    }
+    Serial.println();
+    for (int i = 0; i < TASK_COUNT; i++) {
+        if (!blocked[i]) continue;
+        Serial.print(F("  waiting: "));
+        Serial.println(scheduler_task_name(i));
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include <Arduino.h>
+#include "kernel_config.h"
+
+// Events from interrupt handlers to the scheduler. An ISR posts a 4-byte
+// record into a single-producer/single-consumer ring (ISRs do not nest on
+// AVR, so they count as one producer, and a task posts with interrupts
+// off through event_signal(), which also keeps the preemptive tick out);
+// the loop is the only consumer.
+// Each index is a byte, so either side updates it in one store and no
+// lock is needed.
+//
+// A task subscribes through the events mask of its registry entry and
+// blocks with CO_WAIT_EVENT. It is then not polled: it becomes ready when
+// a subscribed event is delivered, or at the fallback recheck time.
+
+// Event ids, one bit each in a subscription mask
+#define EVENT_ECHO 0      // ranging echo timed (pin change ISR)
+#define EVENT_DISTANCE 1  // reading published on distanceReadings
+#define EVENT_COUNT 8
+
+#define EVENT_BIT(id) (1 << (id))
+
+// The ring holds EVENT_RING (kernel_config.h) records, one slot kept free
+
+struct KernelEvent {
+    uint8_t id;
+    uint8_t arg;
+    uint16_t stamp;  // low 16 bits of micros() at post, for latency
+};
+
+struct EventStats {
+    unsigned long delivered;
+    unsigned long wakeups;       // blocked subscribers made ready
+    unsigned long latencyTotalUs;
+    uint16_t latencyMaxUs;       // post to delivery
+};
+
+extern EventStats eventStats;
+
+void events_init();
+// From an ISR, or elsewhere with interrupts off. Drops the event if the ring is full.
+void event_post(byte id, byte arg);
+// From a task: event_post() with interrupts held off around it (and
+// left as they were)
+void event_signal(byte id, byte arg);
+bool events_pending();
+// Called from the loop: delivers every queued event to its subscribers
+void events_dispatch();
+// The task returned CO_EVENT and waits for one of its events
+void events_block(int index);
+// The task was dispatched, halted, stopped or restarted; it no longer waits
+void events_unblock(int index);
+void events_reset_stats();
+void events_print();
+
+#endif
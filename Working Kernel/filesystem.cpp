@@ -1,22 +1,394 @@
 #include "filesystem.h"
-#include <SPI.h>
+#include "hal.h"
+#include "preempt.h"
 
 const int chipSelect = 4; // Changed to 10, which is the standard CS pin for most Arduino SD card shields
 
+struct FsEntry {
+    char name[FS_NAME_MAX + 1];
+    bool directory;
+    unsigned long size;
+};
+
+struct FsCacheLine {
+    FsFile file;          // owner's slot, FS_NO_FILE when free
+    unsigned long start;  // file offset of data[0], line aligned for reads
+    byte length;          // valid bytes
+    bool dirty;           // appended bytes not yet written to the card
+    uint16_t used;        // LRU stamp
+    byte data[FS_CACHE_LINE];
+};
+
+FsCacheStats fsCacheStats;
+static byte openCount[FS_FILES];  // bumped on every open, so old handles miss
+
+#define FS_SLOT_BITS 2
+#define FS_SLOT(file) ((file) & ((1 << FS_SLOT_BITS) - 1))
+static_assert(FS_FILES <= (1 << FS_SLOT_BITS), "a handle has room for 4 slots");
+static_assert(FS_INDEX_SIZE <= 255, "the index count is a byte");
+static_assert(FS_CACHE_LINES >= 1, "the cache needs a line");
+
+// Slot in the low bits, the slot's open count above, kept non-negative
+static FsFile slot_handle(byte slot) {
+    return ((openCount[slot] & (0x7F >> FS_SLOT_BITS)) << FS_SLOT_BITS) | slot;
+}
+static FsCacheLine cacheLines[FS_CACHE_LINES];
+static uint16_t cacheClock = 0;
+
+static FsEntry fsIndex[FS_INDEX_SIZE];
+static byte fsCount = 0;
+static bool fsComplete = false;  // every root entry is in the index
+static bool sdMounted = false;
+static bool sdEverMounted = false;
+
+static bool card_present() {
+#if SD_CARD_DETECT_PIN >= 0
+    return !hal_pin_read(SD_CARD_DETECT_PIN);
+#else
+    return true;
+#endif
+}
+
+// Only plain root names are indexed; paths go straight to the card
+static bool indexable(const char* name) {
+    return strchr(name + 1, '/') == NULL && strlen(name) <= FS_NAME_MAX;
+}
+
+static FsEntry* index_find(const char* name) {
+    if (*name == '/') name++;
+    for (byte i = 0; i < fsCount; i++) {
+        if (strcasecmp(fsIndex[i].name, name) == 0) return &fsIndex[i];
+    }
+    return NULL;
+}
+
+static void index_put(const char* name, unsigned long size, bool directory) {
+    if (*name == '/') name++;
+    FsEntry* entry = index_find(name);
+    if (entry == NULL) {
+        if (fsCount == FS_INDEX_SIZE || !indexable(name)) {
+            fsComplete = false;
+            return;
+        }
+        entry = &fsIndex[fsCount++];
+        strcpy(entry->name, name);
+    }
+    entry->size = size;
+    entry->directory = directory;
+}
+
+static void index_drop(const char* name) {
+    FsEntry* entry = index_find(name);
+    if (entry != NULL) {
+        *entry = fsIndex[--fsCount];
+    }
+}
+
+// An operation failed on a file the index says is there: assume the card
+// went away and remount on the next access
+static void card_lost() {
+    if (sdMounted) {
+        Serial.println(F("SD card not responding, will remount."));
+        sdMounted = false;
+    }
+}
+
+// After a (re)mount nothing opened before is valid: close it, and drop
+// its cached bytes, which have nowhere to go
+static void files_reset() {
+    for (byte i = 0; i < FS_FILES; i++) {
+        if (hal_file_is_open(i)) hal_file_close(i);
+        openCount[i]++;
+    }
+    for (byte i = 0; i < FS_CACHE_LINES; i++) cacheLines[i].file = FS_NO_FILE;
+}
+
+static void index_entry(const char* name, unsigned long size, bool directory, void*) {
+    index_put(name, size, directory);
+}
+
+static void index_build() {
+    fsCount = 0;
+    fsComplete = true;
+    if (!hal_sd_list(index_entry, NULL)) fsComplete = false;
+}
+
 bool initSDCard() {
+    PreemptGuard guard;
+    if (sdMounted) {
+        if (card_present()) return true;
+        Serial.println(F("SD card removed."));
+        sdMounted = false;
+    }
+#if SD_CARD_DETECT_PIN >= 0
+    hal_pin_input(SD_CARD_DETECT_PIN, true);
+#endif
+    if (!card_present()) {
+        Serial.println(F("No SD card inserted."));
+        return false;
+    }
+    // The library only accepts begin() again after end()
+    if (sdEverMounted) {
+        hal_sd_end();
+    }
+
     // Make sure the SD card chip select pin is set as an output
-    pinMode(chipSelect, OUTPUT);
+    hal_pin_output(chipSelect);
     
     // Try to initialize the SD card with explicit CS pin
-    if (!SD.begin(chipSelect)) {
+    if (!hal_sd_begin(chipSelect)) {
         Serial.println(F("SD Card initialization failed."));
         return false;
     }
+    sdMounted = true;
+    sdEverMounted = true;
+    files_reset();
+    index_build();
     
     Serial.println(F("SD Card initialized successfully."));
     return true;
 }
 
+bool fs_exists(const char* name) {
+    PreemptGuard guard;
+    if (!initSDCard()) return false;
+    if (index_find(name) != NULL) return true;
+    if (fsComplete && indexable(name)) return false;
+    return hal_sd_exists(name);
+}
+
+long fs_size(const char* name) {
+    PreemptGuard guard;
+    if (!initSDCard()) return -1;
+    FsEntry* entry = index_find(name);
+    if (entry != NULL) return entry->size;
+    if (fsComplete && indexable(name)) return -1;
+    return hal_sd_size(name);
+}
+
+bool fs_is_open(FsFile file) {
+    PreemptGuard guard;
+    if (file < 0) return false;
+    byte slot = FS_SLOT(file);
+    return slot < FS_FILES && hal_file_is_open(slot) && slot_handle(slot) == file;
+}
+
+FsFile fs_open(const char* name, uint8_t mode) {
+    PreemptGuard guard;
+    if (!initSDCard()) return FS_NO_FILE;
+    byte slot = 0;
+    while (slot < FS_FILES && hal_file_is_open(slot)) slot++;
+    if (slot == FS_FILES) {
+        Serial.println(F("Too many open files."));
+        return FS_NO_FILE;
+    }
+    bool writing = mode == FS_WRITE;
+    bool known = index_find(name) != NULL;
+    if (!writing && !known && fsComplete && indexable(name)) return FS_NO_FILE;
+    if (!hal_file_open(slot, name, mode)) {
+        if (known || writing) card_lost();
+        return FS_NO_FILE;
+    }
+    if (writing) {
+        index_put(name, hal_file_size(slot), false);
+    }
+    openCount[slot]++;
+    return slot_handle(slot);
+}
+
+bool fs_remove(const char* name) {
+    PreemptGuard guard;
+    if (!initSDCard()) return false;
+    if (fsComplete && indexable(name) && index_find(name) == NULL) return false;
+    if (!hal_sd_remove(name)) return false;
+    index_drop(name);
+    return true;
+}
+
+static void line_touch(FsCacheLine* line) {
+    if (++cacheClock == 0) {
+        // Wrapped: age every line equally rather than keep stale order
+        for (byte i = 0; i < FS_CACHE_LINES; i++) cacheLines[i].used = 0;
+        cacheClock = 1;
+    }
+    line->used = cacheClock;
+}
+
+static bool line_write_back(FsCacheLine* line) {
+    if (!line->dirty) return true;
+    line->dirty = false;
+    fsCacheStats.writeBacks++;
+    if (hal_file_write(FS_SLOT(line->file), line->data, line->length) == line->length) return true;
+    fsCacheStats.failures++;
+    line->file = FS_NO_FILE;
+    return false;
+}
+
+// A free line, else the least recently used one, written back first
+static FsCacheLine* line_claim(FsFile file, unsigned long start) {
+    FsCacheLine* victim = &cacheLines[0];
+    for (byte i = 0; i < FS_CACHE_LINES; i++) {
+        if (cacheLines[i].file == FS_NO_FILE) {
+            victim = &cacheLines[i];
+            break;
+        }
+        if (cacheLines[i].used < victim->used) victim = &cacheLines[i];
+    }
+    if (victim->file != FS_NO_FILE) line_write_back(victim);
+    victim->file = file;
+    victim->start = start;
+    victim->length = 0;
+    victim->dirty = false;
+    line_touch(victim);
+    return victim;
+}
+
+static FsCacheLine* line_find(FsFile file, bool dirty, unsigned long start) {
+    for (byte i = 0; i < FS_CACHE_LINES; i++) {
+        FsCacheLine* line = &cacheLines[i];
+        if (line->file == file && line->dirty == dirty && (dirty || line->start == start)) return line;
+    }
+    return NULL;
+}
+
+static bool file_write_back(FsFile file) {
+    bool ok = true;
+    for (byte i = 0; i < FS_CACHE_LINES; i++) {
+        if (cacheLines[i].file == file && !line_write_back(&cacheLines[i])) ok = false;
+    }
+    return ok;
+}
+
+// Forgets the file's clean lines (all of them with dirtyToo)
+static void file_drop(FsFile file, bool dirtyToo) {
+    for (byte i = 0; i < FS_CACHE_LINES; i++) {
+        if (cacheLines[i].file == file && (dirtyToo || !cacheLines[i].dirty)) cacheLines[i].file = FS_NO_FILE;
+    }
+}
+
+int fs_read_at(FsFile file, unsigned long offset, void* data, unsigned int length) {
+    PreemptGuard guard;
+    if (!fs_is_open(file)) return -1;
+    // Appended bytes have to reach the card before they can be read back
+    if (!file_write_back(file)) return -1;
+    byte* out = (byte*)data;
+    unsigned int done = 0;
+    while (done < length) {
+        unsigned long start = offset - offset % FS_CACHE_LINE;
+        FsCacheLine* line = line_find(file, false, start);
+        if (line != NULL) {
+            fsCacheStats.hits++;
+            line_touch(line);
+        } else {
+            fsCacheStats.misses++;
+            line = line_claim(file, start);
+            int got = hal_file_read_at(FS_SLOT(file), start, line->data, FS_CACHE_LINE);
+            if (got < 0) {
+                line->file = FS_NO_FILE;
+                return -1;
+            }
+            line->length = got;
+        }
+        unsigned int at = offset - start;
+        if (at >= line->length) break;  // end of file
+        unsigned int count = line->length - at;
+        if (count > length - done) count = length - done;
+        memcpy(out + done, line->data + at, count);
+        done += count;
+        offset += count;
+    }
+    return done;
+}
+
+size_t fs_append(FsFile file, const void* data, size_t length) {
+    PreemptGuard guard;
+    if (!fs_is_open(file)) return 0;
+    const byte* in = (const byte*)data;
+    // Cached reads of this file would not see the new bytes
+    file_drop(file, false);
+    FsCacheLine* line = line_find(file, true, 0);
+    size_t done = 0;
+    while (done < length) {
+        if (line == NULL) {
+            line = line_claim(file, hal_file_size(FS_SLOT(file)));
+            line->dirty = true;
+        }
+        size_t count = FS_CACHE_LINE - line->length;
+        if (count > length - done) count = length - done;
+        memcpy(line->data + line->length, in + done, count);
+        line->length += count;
+        done += count;
+        line_touch(line);
+        if (line->length == FS_CACHE_LINE) {
+            // Full: one write for the whole line, then it is an ordinary clean line
+            if (!line_write_back(line)) return 0;
+            line = NULL;
+        }
+    }
+    return length;
+}
+
+unsigned long fs_length(FsFile file) {
+    PreemptGuard guard;
+    if (!fs_is_open(file)) return 0;
+    FsCacheLine* line = line_find(file, true, 0);
+    return hal_file_size(FS_SLOT(file)) + (line != NULL ? line->length : 0);
+}
+
+bool fs_flush() {
+    PreemptGuard guard;
+    bool ok = true;
+    for (byte i = 0; i < FS_CACHE_LINES; i++) {
+        FsCacheLine* line = &cacheLines[i];
+        if (line->file == FS_NO_FILE || !line->dirty) continue;
+        FsFile file = line->file;
+        if (!line_write_back(line)) {
+            ok = false;
+            continue;
+        }
+        hal_file_sync(FS_SLOT(file));
+    }
+    return ok;
+}
+
+bool fs_sync(FsFile file) {
+    PreemptGuard guard;
+    if (!fs_is_open(file)) return false;
+    bool ok = file_write_back(file);
+    byte slot = FS_SLOT(file);
+    hal_file_sync(slot);
+    index_put(hal_file_name(slot), hal_file_size(slot), false);
+    return ok;
+}
+
+// Frees the slot; its cache lines go with it, so a later file in the slot
+// never sees them
+bool fs_close(FsFile file) {
+    PreemptGuard guard;
+    if (!fs_is_open(file)) return false;
+    bool ok = file_write_back(file);
+    file_drop(file, true);
+    byte slot = FS_SLOT(file);
+    index_put(hal_file_name(slot), hal_file_size(slot), false);
+    hal_file_close(slot);
+    return ok;
+}
+
+void fs_cache_print() {
+    Serial.print(F("Cache: "));
+    Serial.print(FS_CACHE_LINES);
+    Serial.print('x');
+    Serial.print(FS_CACHE_LINE);
+    Serial.print(F(" B | hits: "));
+    Serial.print(fsCacheStats.hits);
+    Serial.print(F(" | misses: "));
+    Serial.print(fsCacheStats.misses);
+    Serial.print(F(" | write-backs: "));
+    Serial.print(fsCacheStats.writeBacks);
+    Serial.print(F(" | failed: "));
+    Serial.println(fsCacheStats.failures);
+}
+
 void createFile(const char *filename) {
     // Make sure SD is initialized first
     if (!initSDCard()) {
@@ -24,17 +396,18 @@ void createFile(const char *filename) {
         return;
     }
     
-    if (SD.exists(filename)) {
+    if (fs_exists(filename)) {
         Serial.print(F("File already exists: "));
         Serial.println(filename);
         return;
     }
     
-    File file = SD.open(filename, FILE_WRITE);
-    if (file) {
-        file.print(F("This is the content of "));
-        file.println(filename);
-        file.close();
+    FsFile file = fs_open(filename, FS_WRITE);
+    if (file != FS_NO_FILE) {
+        FsCachedPrint out(file);
+        out.print(F("This is the content of "));
+        out.println(filename);
+        fs_close(file);
         Serial.print(F("Created "));
         Serial.println(filename);
     } else {
@@ -42,6 +415,21 @@ void createFile(const char *filename) {
     }
 }
 
+static void print_entry(const char* name, unsigned long size, bool directory, void* fileCount) {
+    Serial.print(F("  "));
+    Serial.print(name);
+    if (directory) {
+        Serial.print(F(" (directory)"));
+    } else {
+        // Display file size
+        Serial.print(F(" ("));
+        Serial.print(size);
+        Serial.print(F(" bytes)"));
+    }
+    Serial.println();
+    if (!directory) (*(int*)fileCount)++;
+}
+
 void listFiles() {
     // Make sure SD is initialized first
     if (!initSDCard()) {
@@ -49,37 +437,26 @@ void listFiles() {
         return;
     }
     
-    File root = SD.open("/");
-    if (!root) {
-        Serial.println(F("Failed to open root directory."));
-        return;
-    }
-    
     Serial.println(F("\n--- SD Card Contents ---"));
     
     // Count number of files
     int fileCount = 0;
-    while (File entry = root.openNextFile()) {
-        Serial.print(F("  "));
-        Serial.print(entry.name());
-        if (entry.isDirectory()) {
-            Serial.print(F(" (directory)"));
-        } else {
-            // Display file size
-            Serial.print(F(" ("));
-            Serial.print(entry.size());
-            Serial.print(F(" bytes)"));
-            fileCount++;
+    if (fsComplete) {
+        for (byte i = 0; i < fsCount; i++) {
+            print_entry(fsIndex[i].name, fsIndex[i].size, fsIndex[i].directory, &fileCount);
         }
-        Serial.println();
-        entry.close();
+    } else if (!hal_sd_list(print_entry, &fileCount)) {
+        // More entries than the index holds, and the card did not answer
+        card_lost();
+        Serial.println(F("Failed to open root directory."));
+        return;
     }
     
     if (fileCount == 0) {
         Serial.println(F("  No files found."));
     }
+    fs_cache_print();
     
-    root.close();
     Serial.println(F("------------------------"));
 }
 
@@ -90,8 +467,8 @@ void deleteFile(const char *filename) {
         return;
     }
     
-    if (SD.exists(filename)) {
-        if (SD.remove(filename)) {
+    if (fs_exists(filename)) {
+        if (fs_remove(filename)) {
             Serial.print(F("Deleted "));
             Serial.println(filename);
         } else {
@@ -101,4 +478,4 @@ void deleteFile(const char *filename) {
         Serial.print(F("File not found: "));
         Serial.println(filename);
     }
-}
\ No newline at end of file
+}
@@ -2,12 +2,88 @@
 #define FILESYSTEM_H
 
 #include <Arduino.h>
-#include <SD.h>
+#include "hal.h"
+#include "kernel_config.h"
 
-// Function to initialize SD card
+// The card is mounted once and the root directory is mirrored in a small
+// RAM index, so exists/size lookups and VIEW do not walk the card. Writers
+// go through fs_open/fs_sync/fs_close to keep the index current. Every
+// fs_* call holds preemption off (preempt.h), so a preempted task never
+// leaves the cache, the SD library's block or the SPI bus half used.
+#define SD_CARD_DETECT_PIN -1  // card-detect switch to GND, -1 if not wired
+// FS_INDEX_SIZE (kernel_config.h) root entries are mirrored; more fall back to SD
+#define FS_NAME_MAX 12         // 8.3
+
+// Open files sit in the HAL's file slots and callers hold a handle (slot
+// number and a per-slot open count), so no file object is copied around
+// or left on a stack. A handle is valid from fs_open until fs_close or a remount;
+// after that it is refused, even once the slot holds another file.
+#define FS_FILES HAL_FILES  // 2: the CSV export reads one and writes one
+#define FS_NO_FILE -1
+#define FS_READ HAL_FILE_READ
+#define FS_WRITE HAL_FILE_APPEND  // create if missing, append
+
+typedef int8_t FsFile;
+
+// Write-back line cache between the kernel's file users and the SD
+// library. Reads are served from FS_CACHE_LINE-byte lines, appends are
+// collected in a line and written when it fills, on fs_sync/fs_close, or
+// on fs_flush. Lines belong to one open file's slot, are evicted least
+// recently used, and are dropped when fs_close frees the slot. The SD
+// library keeps its own single 512-byte block for data, FAT and directory
+// alike; it offers no hook to add blocks or pin FAT/directory sectors, so
+// the cache cuts how often the kernel calls into it instead: fewer, larger
+// reads and writes, and no round trip through that block for every record
+// or print. FS_CACHE_LINES (kernel_config.h) lines are kept.
+#define FS_CACHE_LINE 32
+
+struct FsCacheStats {
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long writeBacks;  // dirty lines written to the card
+    unsigned int failures;     // write-backs the card refused, data dropped
+};
+
+extern FsCacheStats fsCacheStats;
+
+// Mounts the card if needed (remounting after removal); cheap when mounted
 bool initSDCard();
+bool fs_exists(const char* name);
+// Size in bytes, -1 if the file does not exist
+long fs_size(const char* name);
+// FS_NO_FILE if it cannot be opened or every slot is in use
+FsFile fs_open(const char* name, uint8_t mode);
+bool fs_remove(const char* name);
+// Flush / close a written file and record its size in the index; false
+// if cached bytes could not be written
+bool fs_sync(FsFile file);
+bool fs_close(FsFile file);
+
+// Reads up to length bytes at offset through the cache, -1 on error
+int fs_read_at(FsFile file, unsigned long offset, void* data, unsigned int length);
+// Appends through the cache; returns length, or 0 if a write-back failed
+size_t fs_append(FsFile file, const void* data, size_t length);
+// Size of an open file, including appended bytes still cached
+unsigned long fs_length(FsFile file);
+bool fs_is_open(FsFile file);
+// Writes every dirty line back to the card
+bool fs_flush();
+void fs_cache_print();
+
+// Print into the cache, so each piece does not go to the card on its own
+class FsCachedPrint : public Print {
+public:
+    explicit FsCachedPrint(FsFile file) : file(file) {}
+    size_t write(uint8_t value) { return fs_append(file, &value, 1); }
+    size_t write(const uint8_t* data, size_t length) { return fs_append(file, data, length); }
+    using Print::write;
+
+private:
+    FsFile file;
+};
+
 void createFile(const char *filename);
 void deleteFile(const char *filename);
 void listFiles();
 
-#endif
\ No newline at end of file
+#endif
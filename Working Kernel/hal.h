@@ -0,0 +1,109 @@
+#ifndef HAL_H
+#define HAL_H
+
+#include <Arduino.h>
+#include "kernel_config.h"
+
+// Hardware access for the kernel modules: time, sleep, GPIO, I2C, the SD
+// card, the Bluetooth serial port and the console input side. The Arduino
+// backend (hal_arduino.h, hal_arduino.cpp) is the default; most of it is
+// inlined, so it costs nothing over calling the core directly. Another
+// port, such as the host build in host/, defines HAL_EXTERNAL and links
+// its own definitions of these. Storage sits on top: the swap area uses
+// I2C through eeprom.cpp and files go through filesystem.cpp.
+
+// Time
+unsigned long hal_millis();
+unsigned long hal_micros();
+void hal_delay_us(unsigned int us);
+
+// Interrupts off; hal_irq_restore() puts back the state hal_irq_save() found,
+// so either can be used where interrupts may already be off
+uint8_t hal_irq_save();
+void hal_irq_restore(uint8_t state);
+
+// Sleep until an interrupt or for at most ms (HAL_SLEEP_UNTIMED: no limit;
+// 0 returns at once). Call with interrupts off (hal_irq_save), after
+// checking there is nothing to do; returns with them on. A tickless
+// backend (HAL_TICKLESS) is not woken by its own clock tick, so this can
+// last the whole ms; otherwise the tick ends it within about 1 ms.
+#define HAL_SLEEP_UNTIMED 0xFFFFFFFFUL
+void hal_sleep_cpu(unsigned long ms);
+
+// GPIO
+void hal_pin_output(uint8_t pin);
+void hal_pin_input(uint8_t pin, bool pullup);
+void hal_pin_write(uint8_t pin, bool high);
+bool hal_pin_read(uint8_t pin);
+// handler runs in interrupt context on every edge of pin
+void hal_pin_on_change(uint8_t pin, void (*handler)());
+
+// I2C master. hal_i2c_begin() once at startup. A write sends head then data in one transaction; with
+// stop false the bus is held for a repeated-start read.
+void hal_i2c_begin();
+bool hal_i2c_probe(uint8_t device);
+bool hal_i2c_write(uint8_t device, const uint8_t* head, uint8_t headLength,
+                   const uint8_t* data, uint8_t length, bool stop);
+bool hal_i2c_read(uint8_t device, uint8_t* data, uint8_t length);
+
+// SD card, root directory only. Files are opened into slots 0..HAL_FILES-1
+// that the caller (filesystem.cpp) hands out; a slot holds one file from
+// hal_file_open until hal_file_close.
+#define HAL_FILES 2
+#define HAL_FILE_READ 0
+#define HAL_FILE_APPEND 1  // created if missing, writes go to the end
+
+// hal_sd_begin() again after hal_sd_end() remounts
+bool hal_sd_begin(uint8_t chipSelect);
+void hal_sd_end();
+bool hal_sd_exists(const char* name);
+// Size in bytes, -1 if there is no such file
+long hal_sd_size(const char* name);
+bool hal_sd_remove(const char* name);
+// Calls entry once per root entry; false if the root cannot be read
+bool hal_sd_list(void (*entry)(const char* name, unsigned long size, bool directory, void* context),
+                 void* context);
+
+bool hal_file_open(uint8_t slot, const char* name, uint8_t mode);
+bool hal_file_is_open(uint8_t slot);
+void hal_file_close(uint8_t slot);
+const char* hal_file_name(uint8_t slot);
+unsigned long hal_file_size(uint8_t slot);
+// Bytes read at offset (0 at the end), -1 on error
+int hal_file_read_at(uint8_t slot, unsigned long offset, void* data, unsigned int length);
+// Appends; returns the bytes written
+size_t hal_file_write(uint8_t slot, const void* data, size_t length);
+void hal_file_sync(uint8_t slot);
+
+// Bluetooth module serial port, used through bt_link's BT_LINK_HAL backend.
+// On the Arduino backend bt_link.cpp drives the UART itself instead.
+void hal_bt_begin(unsigned long baud);
+int hal_bt_available();
+int hal_bt_read();
+int hal_bt_peek();
+size_t hal_bt_write(uint8_t value);
+int hal_bt_tx_room();
+
+// Console input and output flow control; output itself uses Serial's Print
+void hal_console_begin(unsigned long baud);
+int hal_console_available();
+int hal_console_read();
+int hal_console_tx_room();
+
+#ifndef HAL_EXTERNAL
+#include "hal_arduino.h"
+#endif
+
+#ifndef HAL_TICKLESS
+#define HAL_TICKLESS 0
+#endif
+
+// Largest I2C transfers; a backend with bigger buffers defines these first
+#ifndef HAL_I2C_MAX_WRITE
+#define HAL_I2C_MAX_WRITE 32
+#endif
+#ifndef HAL_I2C_MAX_READ
+#define HAL_I2C_MAX_READ 32
+#endif
+
+#endif
@@ -0,0 +1,243 @@
+#include "hal.h"
+
+#ifndef HAL_EXTERNAL
+#include <SPI.h>
+#include <SD.h>
+
+static File files[HAL_FILES];
+
+bool hal_sd_begin(uint8_t chipSelect) {
+    return SD.begin(chipSelect);
+}
+
+void hal_sd_end() {
+    SD.end();
+}
+
+bool hal_sd_exists(const char* name) {
+    return SD.exists(name);
+}
+
+long hal_sd_size(const char* name) {
+    File file = SD.open(name, FILE_READ);
+    if (!file) return -1;
+    long size = file.size();
+    file.close();
+    return size;
+}
+
+bool hal_sd_remove(const char* name) {
+    return SD.remove(name);
+}
+
+bool hal_sd_list(void (*entry)(const char* name, unsigned long size, bool directory, void* context),
+                 void* context) {
+    File root = SD.open("/");
+    if (!root) return false;
+    while (File file = root.openNextFile()) {
+        entry(file.name(), file.size(), file.isDirectory(), context);
+        file.close();
+    }
+    root.close();
+    return true;
+}
+
+bool hal_file_open(uint8_t slot, const char* name, uint8_t mode) {
+    files[slot] = SD.open(name, mode == HAL_FILE_APPEND ? FILE_WRITE : FILE_READ);
+    return files[slot];
+}
+
+bool hal_file_is_open(uint8_t slot) {
+    return files[slot];
+}
+
+void hal_file_close(uint8_t slot) {
+    files[slot].close();
+}
+
+const char* hal_file_name(uint8_t slot) {
+    return files[slot].name();
+}
+
+unsigned long hal_file_size(uint8_t slot) {
+    return files[slot].size();
+}
+
+int hal_file_read_at(uint8_t slot, unsigned long offset, void* data, unsigned int length) {
+    if (!files[slot].seek(offset)) return -1;
+    return files[slot].read(data, length);
+}
+
+size_t hal_file_write(uint8_t slot, const void* data, size_t length) {
+    return files[slot].write((const uint8_t*)data, length);
+}
+
+void hal_file_sync(uint8_t slot) {
+    files[slot].flush();
+}
+#endif
+
+#if !defined(HAL_EXTERNAL) && HAL_TICKLESS
+// Tickless idle. Timer0's overflow interrupt (millis) is masked for the
+// sleep and Timer1, on the same clk/64 prescaler, counts the time and
+// wakes the CPU with a compare match. Afterwards the overflows Timer0
+// missed are credited to halSleptUs/halSleptMs. One sleep lasts at most
+// HAL_TICKLESS_MAX_COUNTS (260 ms at 16 MHz), short of where TCNT1 would
+// wrap before it is read; short ones keep the tick.
+#define HAL_TICKLESS_MIN_MS 2
+#define HAL_TICKLESS_MAX_COUNTS 65000UL
+#define HAL_TIMER0_OVERFLOW_US (256 * HAL_TIMER_US)
+
+volatile bool halSleeping = false;
+unsigned long halSleepStart;
+unsigned long halSleptUs = 0;
+unsigned long halSleptMs = 0;
+static unsigned int sleptFraction = 0;  // µs not yet in halSleptMs
+
+// Only wakes the CPU
+EMPTY_INTERRUPT(TIMER1_COMPA_vect);
+
+static void idle_sleep() {
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    sleep_enable();
+    sei();  // takes effect after the next instruction, so no wakeup is lost
+    sleep_cpu();
+    sleep_disable();
+}
+
+void hal_sleep_cpu(unsigned long ms) {
+    if (ms < HAL_TICKLESS_MIN_MS) {
+        if (ms == 0) {
+            sei();
+        } else {
+            idle_sleep();
+        }
+        return;
+    }
+    unsigned long counts = HAL_TICKLESS_MAX_COUNTS;
+    if (ms < HAL_TICKLESS_MAX_COUNTS * HAL_TIMER_US / 1000) counts = ms * 1000 / HAL_TIMER_US;
+
+    halSleepStart = hal_micros();
+    TCCR1A = 0;
+    TCCR1B = 0;
+    TCNT1 = 0;
+    OCR1A = counts;
+    TIFR1 = _BV(OCF1A);
+    TIMSK1 = _BV(OCIE1A);
+    TIMSK0 &= ~_BV(TOIE0);
+    uint8_t start = TCNT0;
+    // An overflow from before start that the core has yet to count; at 255
+    // a set flag may be the wrap right after the read (as in micros())
+    bool pending = (TIFR0 & _BV(TOV0)) && start != 255;
+    TCCR1B = _BV(CS11) | _BV(CS10);
+    halSleeping = true;
+    idle_sleep();
+
+    cli();
+    TCCR1B = 0;
+    halSleeping = false;
+    TIMSK1 = 0;
+    uint8_t end = TCNT0;
+    // Timer1 started a count or so after start was read; Timer0's own
+    // count settles the difference
+    unsigned int elapsed = TCNT1;
+    elapsed += (int8_t)(end - (uint8_t)(start + elapsed));
+    unsigned int overflows = (start + (unsigned long)elapsed) >> 8;
+    // The TOV0 flag holds one overflow for the core's ISR to count
+    if (overflows > 0 && !pending) overflows--;
+    unsigned long us = (unsigned long)overflows * HAL_TIMER0_OVERFLOW_US;
+    halSleptUs += us;
+    halSleptMs += us / 1000;
+    sleptFraction += us % 1000;
+    if (sleptFraction >= 1000) {
+        sleptFraction -= 1000;
+        halSleptMs++;
+    }
+    TIMSK0 |= _BV(TOIE0);
+    sei();
+}
+#endif
+
+#if !defined(HAL_EXTERNAL) && defined(HAL_I2C_TWI)
+#include <util/twi.h>
+
+// Each step of a transaction is started by writing TWCR and is done when
+// the hardware sets TWINT. Give up after ~25 ms so a stuck bus returns an
+// error instead of hanging the kernel.
+static bool twi_wait() {
+    unsigned int spins = 0;
+    while (!(TWCR & _BV(TWINT))) {
+        if (++spins == 0) {
+            TWCR = 0;  // release the lines; the next start re-enables
+            return false;
+        }
+    }
+    return true;
+}
+
+static uint8_t twi_status() {
+    return TW_STATUS;
+}
+
+static void twi_stop() {
+    TWCR = _BV(TWINT) | _BV(TWSTO) | _BV(TWEN);
+    unsigned int spins = 0;
+    while ((TWCR & _BV(TWSTO)) && ++spins != 0) {
+    }
+}
+
+// (Repeated) start and address; true once the device ACKed
+static bool twi_start(uint8_t device, bool read) {
+    TWCR = _BV(TWINT) | _BV(TWSTA) | _BV(TWEN);
+    if (!twi_wait() || (twi_status() != TW_START && twi_status() != TW_REP_START)) return false;
+    TWDR = (device << 1) | (read ? TW_READ : TW_WRITE);
+    TWCR = _BV(TWINT) | _BV(TWEN);
+    return twi_wait() && twi_status() == (read ? TW_MR_SLA_ACK : TW_MT_SLA_ACK);
+}
+
+static bool twi_send(const uint8_t* data, uint8_t length) {
+    for (uint8_t i = 0; i < length; i++) {
+        TWDR = data[i];
+        TWCR = _BV(TWINT) | _BV(TWEN);
+        if (!twi_wait() || twi_status() != TW_MT_DATA_ACK) return false;
+    }
+    return true;
+}
+
+void hal_i2c_begin() {
+    // Internal pull-ups on SDA/SCL, as Wire sets them
+    hal_pin_input(SDA, true);
+    hal_pin_input(SCL, true);
+    TWSR = 0;  // prescaler 1
+    TWBR = ((F_CPU / HAL_I2C_HZ) - 16) / 2;
+    TWCR = _BV(TWEN);
+}
+
+bool hal_i2c_probe(uint8_t device) {
+    bool ok = twi_start(device, false);
+    twi_stop();
+    return ok;
+}
+
+bool hal_i2c_write(uint8_t device, const uint8_t* head, uint8_t headLength,
+                   const uint8_t* data, uint8_t length, bool stop) {
+    bool ok = twi_start(device, false) && twi_send(head, headLength) && twi_send(data, length);
+    // Without stop the bus stays held for the repeated start of a read
+    if (stop || !ok) twi_stop();
+    return ok;
+}
+
+bool hal_i2c_read(uint8_t device, uint8_t* data, uint8_t length) {
+    bool ok = twi_start(device, true);
+    for (uint8_t i = 0; ok && i < length; i++) {
+        // ACK every byte but the last, which tells the device to stop sending
+        bool last = i + 1 == length;
+        TWCR = _BV(TWINT) | _BV(TWEN) | (last ? 0 : _BV(TWEA));
+        ok = twi_wait() && twi_status() == (last ? TW_MR_DATA_NACK : TW_MR_DATA_ACK);
+        if (ok) data[i] = TWDR;
+    }
+    twi_stop();
+    return ok;
+}
+
+#endif
@@ -0,0 +1,136 @@
+#ifndef HAL_ARDUINO_H
+#define HAL_ARDUINO_H
+
+// Default HAL backend over the Arduino core, included by hal.h. The SD
+// card, tickless sleep and the AVR I2C master live in hal_arduino.cpp.
+#include <Arduino.h>
+#include "kernel_config.h"
+#if defined(__AVR__)
+#include <avr/sleep.h>
+#endif
+
+#if defined(__AVR__) && defined(TWCR)
+// AVR: polled master on the TWI registers (hal_arduino.cpp) instead of
+// Wire, which keeps five 32-byte buffers in RAM for one EEPROM
+#define HAL_I2C_TWI 1
+#define HAL_I2C_HZ 100000UL
+#define HAL_I2C_MAX_WRITE 255
+#define HAL_I2C_MAX_READ 255
+#else
+#include <Wire.h>
+// Largest transfers one Wire transaction can carry
+#ifdef BUFFER_LENGTH
+#define HAL_I2C_MAX_WRITE BUFFER_LENGTH
+#define HAL_I2C_MAX_READ BUFFER_LENGTH
+#else
+#define HAL_I2C_MAX_WRITE 32
+#define HAL_I2C_MAX_READ 32
+#endif
+#endif
+
+#if defined(__AVR_ATmega328P__) && !defined(HAL_TICKLESS) && !KERNEL_PREEMPTIVE
+// Idle sleeps through the 1 kHz Timer0 tick and is woken by a Timer1
+// compare match instead (hal_arduino.cpp). The preemptive mode needs
+// Timer1 for its own tick, so it keeps waking every millisecond.
+#define HAL_TICKLESS 1
+#endif
+
+#if HAL_TICKLESS
+// Timer0 overflows slept through, which millis() and micros() never saw
+extern volatile bool halSleeping;
+extern unsigned long halSleepStart;  // hal_micros() when the sleep began
+extern unsigned long halSleptUs;
+extern unsigned long halSleptMs;
+#define HAL_TIMER_US (64 / (F_CPU / 1000000UL))  // one count at clk/64
+
+inline unsigned long hal_millis() { return millis() + halSleptMs; }
+// An ISR that wakes the CPU finds Timer0's overflow count stale, so time
+// comes from Timer1 until the sleep is accounted for. hal_millis() stands
+// still in such an ISR.
+inline unsigned long hal_micros() {
+    if (halSleeping) return halSleepStart + (unsigned long)TCNT1 * HAL_TIMER_US;
+    return micros() + halSleptUs;
+}
+#else
+inline unsigned long hal_millis() { return millis(); }
+inline unsigned long hal_micros() { return micros(); }
+#endif
+inline void hal_delay_us(unsigned int us) { delayMicroseconds(us); }
+
+#if defined(__AVR__)
+inline uint8_t hal_irq_save() {
+    uint8_t sreg = SREG;
+    cli();
+    return sreg;
+}
+inline void hal_irq_restore(uint8_t state) { SREG = state; }
+
+#if HAL_TICKLESS
+void hal_sleep_cpu(unsigned long ms);
+#else
+inline void hal_sleep_cpu(unsigned long ms) {
+    if (ms == 0) {
+        sei();
+        return;
+    }
+    // IDLE keeps Timer0 (millis) and the UARTs running; its tick wakes us
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    sleep_enable();
+    sei();  // takes effect after the next instruction, so no wakeup is lost
+    sleep_cpu();
+    sleep_disable();
+}
+#endif
+#else
+// No portable way to read the mask: assume interrupts were on
+inline uint8_t hal_irq_save() {
+    noInterrupts();
+    return 1;
+}
+inline void hal_irq_restore(uint8_t state) {
+    if (state) interrupts();
+}
+
+// No portable sleep: return at once and let the caller poll
+inline void hal_sleep_cpu(unsigned long) { interrupts(); }
+#endif
+
+inline void hal_pin_output(uint8_t pin) { pinMode(pin, OUTPUT); }
+inline void hal_pin_input(uint8_t pin, bool pullup) { pinMode(pin, pullup ? INPUT_PULLUP : INPUT); }
+inline void hal_pin_write(uint8_t pin, bool high) { digitalWrite(pin, high ? HIGH : LOW); }
+inline bool hal_pin_read(uint8_t pin) { return digitalRead(pin) == HIGH; }
+inline void hal_pin_on_change(uint8_t pin, void (*handler)()) {
+    attachInterrupt(digitalPinToInterrupt(pin), handler, CHANGE);
+}
+
+#ifndef HAL_I2C_TWI
+inline void hal_i2c_begin() { Wire.begin(); }
+
+inline bool hal_i2c_probe(uint8_t device) {
+    Wire.beginTransmission(device);
+    return Wire.endTransmission() == 0;
+}
+
+inline bool hal_i2c_write(uint8_t device, const uint8_t* head, uint8_t headLength,
+                          const uint8_t* data, uint8_t length, bool stop) {
+    Wire.beginTransmission(device);
+    Wire.write(head, headLength);
+    if (length > 0) Wire.write(data, length);
+    return Wire.endTransmission(stop) == 0;
+}
+
+inline bool hal_i2c_read(uint8_t device, uint8_t* data, uint8_t length) {
+    if (Wire.requestFrom(device, length) != length) return false;
+    for (uint8_t i = 0; i < length; i++) {
+        data[i] = Wire.read();
+    }
+    return true;
+}
+#endif
+
+inline void hal_console_begin(unsigned long baud) { Serial.begin(baud); }
+inline int hal_console_available() { return Serial.available(); }
+inline int hal_console_read() { return Serial.read(); }
+inline int hal_console_tx_room() { return Serial.availableForWrite(); }
+
+#endif
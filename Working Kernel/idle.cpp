@@ -0,0 +1,38 @@
+#include "idle.h"
+#include "klog.h"
+#include "events.h"
+#include "hal.h"
+
+IdleStats idleStats;
+
+static bool idle_should_wake(bool timed, unsigned long deadline) {
+    if (hal_console_available() > 0) return true;
+    if (events_pending()) return true;
+    if (klog_can_drain()) return true;
+    return timed && (long)(hal_millis() - deadline) >= 0;
+}
+
+void idle_sleep_until(bool timed, unsigned long deadline) {
+    if (idle_should_wake(timed, deadline)) return;
+    unsigned long start = hal_millis();
+    idleStats.sleeps++;
+    // Sleep to the deadline; any interrupt (a received byte, an event, the
+    // clock tick on a backend that is not tickless) wakes us early. Recheck
+    // cheaply and sleep again instead of returning to loop() and polling
+    // every task.
+    for (;;) {
+        uint8_t irq = hal_irq_save();
+        if (idle_should_wake(timed, deadline)) {
+            hal_irq_restore(irq);
+            break;
+        }
+        unsigned long ms = HAL_SLEEP_UNTIMED;
+        if (timed) {
+            long left = (long)(deadline - hal_millis());
+            ms = left > 0 ? left : 0;
+        }
+        hal_sleep_cpu(ms);
+        idleStats.wakeups++;
+    }
+    idleStats.idleMillis += hal_millis() - start;
+}
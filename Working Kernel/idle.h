@@ -0,0 +1,19 @@
+#ifndef IDLE_H
+#define IDLE_H
+
+#include <Arduino.h>
+
+// Idle sleep counters
+struct IdleStats {
+    unsigned long sleeps;      // times the loop went idle
+    unsigned long wakeups;     // interrupts that woke the CPU while idle
+    unsigned long idleMillis;  // total time spent asleep
+};
+
+extern IdleStats idleStats;
+
+// Sleep until the deadline passes (if timed), Serial input or an event
+// arrives, or queued log output fits in the TX buffer
+void idle_sleep_until(bool timed, unsigned long deadline);
+
+#endif
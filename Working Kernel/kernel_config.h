@@ -0,0 +1,78 @@
+#ifndef KERNEL_CONFIG_H
+#define KERNEL_CONFIG_H
+
+// Build options and static capacities. Each can be passed to the compiler
+// (-DNAME=value) or changed here; every header that uses one includes this
+// file first, so all of them see the same value. The Arduino IDE has no
+// per-sketch compiler flags, so on the board this is the place to change
+// them. The RAM table in README.md is for the values below.
+
+// Modes
+
+// Dispatch policy (scheduler.h): 0 fixed priority, 1 EDF
+#ifndef SCHED_POLICY
+#define SCHED_POLICY 0
+#endif
+
+// Periods are stored in 16 bits as ticks of this many ms (scheduler.h)
+#ifndef TASK_TICK_MS
+#define TASK_TICK_MS 1
+#endif
+
+// Preemptive dispatch (preempt.h): 0 off, 1 on. Takes Timer1, so the
+// ATmega328P backend then keeps waking on the 1 ms tick (hal_arduino.h).
+#ifndef KERNEL_PREEMPTIVE
+#define KERNEL_PREEMPTIVE 0
+#endif
+
+// The "bench" command and its scratch tasks (bench.h), about 2 KB of flash
+#ifndef KERNEL_BENCHMARK
+#define KERNEL_BENCHMARK 0
+#endif
+
+// Capacities; each sizes a static array
+
+// Tasks resident in RAM at once; past it admitted tasks take turns
+// through the swap log (scheduler.h). Every registry task has a
+// ScheduledTask slot either way.
+#ifndef MAX_TASKS
+#define MAX_TASKS 3
+#endif
+
+// Event records between ISRs and the loop (events.h); a power of two, one
+// slot is kept free
+#ifndef EVENT_RING
+#define EVENT_RING 8
+#endif
+
+// Kernel log records waiting for the console (klog.h), at most 255
+#ifndef KLOG_RING
+#define KLOG_RING 8
+#endif
+
+// Samples queued from the distance task to the logger (distance_task.h),
+// 2..128; one slot is kept free
+#ifndef DISTANCE_CHANNEL_SIZE
+#define DISTANCE_CHANNEL_SIZE 8
+#endif
+
+// Root directory entries mirrored in RAM (filesystem.h); more fall back to SD
+#ifndef FS_INDEX_SIZE
+#define FS_INDEX_SIZE 4
+#endif
+
+// 32-byte lines of the file cache (filesystem.h)
+#ifndef FS_CACHE_LINES
+#define FS_CACHE_LINES 2
+#endif
+
+// Software UART rings of the Bluetooth link (bt_link.h); powers of two,
+// at most 128. A byte lost to a full RX ring costs a NAK.
+#ifndef BT_LINK_RX_BUFFER
+#define BT_LINK_RX_BUFFER 32
+#endif
+#ifndef BT_LINK_TX_BUFFER
+#define BT_LINK_TX_BUFFER 16
+#endif
+
+#endif
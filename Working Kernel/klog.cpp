@@ -0,0 +1,111 @@
+#include "klog.h"
+#include "scheduler.h"
+#include "hal.h"
+#include "preempt.h"
+
+#define KLOG_ARG_NONE 0
+#define KLOG_ARG_TASK 1   // print the name of taskList[task]
+#define KLOG_ARG_VALUE 2  // print value
+
+struct KlogRecord {
+    byte id;
+    byte task;
+    uint16_t value;
+};
+
+struct KlogFormat {
+    byte level;
+    byte arg;
+    const char* prefix;  // PROGMEM
+    const char* suffix;  // PROGMEM
+};
+
+static const char textEmpty[] PROGMEM = "";
+static const char textSwapOut[] PROGMEM = "Swapped out task: ";
+static const char textSwapIn[] PROGMEM = "Swapped in task: ";
+static const char textWriteFail[] PROGMEM = "EEPROM write failed for task: ";
+static const char textReadFail[] PROGMEM = "EEPROM read failed for task: ";
+static const char textDistance[] PROGMEM = "Distance: ";
+static const char textCm[] PROGMEM = " cm";
+static const char textOverflow[] PROGMEM = "Stack overflow, task stopped: ";
+static const char textNoRoom[] PROGMEM = "No RAM slot to swap in task: ";
+
+static const KlogFormat klogFormats[] PROGMEM = {
+    { KLOG_INFO,  KLOG_ARG_TASK,  textSwapOut,   textEmpty }, // KLOG_SWAP_OUT
+    { KLOG_INFO,  KLOG_ARG_TASK,  textSwapIn,    textEmpty }, // KLOG_SWAP_IN
+    { KLOG_ERROR, KLOG_ARG_TASK,  textWriteFail, textEmpty }, // KLOG_SWAP_WRITE_FAIL
+    { KLOG_ERROR, KLOG_ARG_TASK,  textReadFail,  textEmpty }, // KLOG_SWAP_READ_FAIL
+    { KLOG_INFO,  KLOG_ARG_VALUE, textDistance,  textCm },    // KLOG_DISTANCE
+    { KLOG_ERROR, KLOG_ARG_TASK,  textOverflow,  textEmpty }, // KLOG_STACK_OVERFLOW
+    { KLOG_ERROR, KLOG_ARG_TASK,  textNoRoom,    textEmpty }, // KLOG_SWAP_NO_ROOM
+};
+
+byte klogLevel = KLOG_INFO;
+unsigned int klogDropped = 0;
+
+static_assert(KLOG_RING >= 1 && KLOG_RING <= 255, "KLOG_RING must be 1..255");
+static KlogRecord ring[KLOG_RING];
+static byte ringHead = 0;
+static byte ringCount = 0;
+static unsigned int droppedReported = 0;
+// Set by a drop notice until the ring empties: the records queued behind
+// it go first, or a drop per drain would print notices and nothing else
+static bool droppedShown = false;
+
+static void klog_push(byte id, byte task, uint16_t value) {
+    if (ringCount == KLOG_RING) {
+        klogDropped++;
+        return;
+    }
+    KlogRecord* record = &ring[ringHead];
+    record->id = id;
+    record->task = task;
+    record->value = value;
+    ringHead = (ringHead + 1) % KLOG_RING;
+    ringCount++;
+}
+
+void klog_event(byte id, byte task, uint16_t value) {
+    if (pgm_read_byte(&klogFormats[id].level) > klogLevel) return;
+    // Tasks log too; keep a preempted push from racing the drain
+    preempt_lock();
+    klog_push(id, task, value);
+    preempt_unlock();
+}
+
+bool klog_pending() {
+    return ringCount > 0 || droppedReported != klogDropped;
+}
+
+bool klog_can_drain() {
+    return klog_pending() && hal_console_tx_room() >= KLOG_LINE_ROOM;
+}
+
+static void print_progmem(const char* s) {
+    Serial.print(reinterpret_cast<const __FlashStringHelper*>(s));
+}
+
+void klog_drain() {
+    while (klog_can_drain()) {
+        if (droppedReported != klogDropped && (!droppedShown || ringCount == 0)) {
+            Serial.print(F("[log] dropped "));
+            Serial.println(klogDropped - droppedReported);
+            droppedReported = klogDropped;
+            droppedShown = ringCount > 0;
+            continue;
+        }
+        KlogRecord* record = &ring[(ringHead + KLOG_RING - ringCount) % KLOG_RING];
+        KlogFormat format;
+        memcpy_P(&format, &klogFormats[record->id], sizeof(format));
+        print_progmem(format.prefix);
+        if (format.arg == KLOG_ARG_TASK) {
+            Serial.print(scheduler_task_name(record->task));
+        } else if (format.arg == KLOG_ARG_VALUE) {
+            Serial.print(record->value);
+        }
+        print_progmem(format.suffix);
+        Serial.println();
+        ringCount--;
+        if (ringCount == 0) droppedShown = false;
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef KLOG_H
+#define KLOG_H
+
+#include <Arduino.h>
+#include "kernel_config.h"
+
+// Deferred logging. Hot-path code queues a 4-byte record; klog_drain()
+// formats it later, and only while the UART TX buffer has room for a line.
+
+#define KLOG_ERROR 0
+#define KLOG_WARN 1
+#define KLOG_INFO 2
+#define KLOG_DEBUG 3
+
+// Event ids, index into the format table in klog.cpp
+#define KLOG_SWAP_OUT 0
+#define KLOG_SWAP_IN 1
+#define KLOG_SWAP_WRITE_FAIL 2
+#define KLOG_SWAP_READ_FAIL 3
+#define KLOG_DISTANCE 4
+#define KLOG_STACK_OVERFLOW 5
+#define KLOG_SWAP_NO_ROOM 6
+
+// Records wait in a ring of KLOG_RING (kernel_config.h)
+#define KLOG_LINE_ROOM 48  // TX space needed before a record is formatted
+
+extern byte klogLevel;
+extern unsigned int klogDropped;
+
+void klog_event(byte id, byte task, uint16_t value);
+inline void klog_task(byte id, byte task) { klog_event(id, task, 0); }
+inline void klog_value(byte id, uint16_t value) { klog_event(id, 0, value); }
+
+bool klog_pending();
+bool klog_can_drain();
+void klog_drain();
+
+#endif
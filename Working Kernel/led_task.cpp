@@ -1,19 +1,14 @@
 #include "led_task.h"
-#include <Arduino.h>
+#include "hal.h"
 
 void setup_led() {
-    pinMode(LED_BUILTIN, OUTPUT);
-    digitalWrite(LED_BUILTIN, LOW);
+    hal_pin_output(LED_BUILTIN);
+    hal_pin_write(LED_BUILTIN, false);
 }
 
+// One toggle per job: the period is the half blink cycle
 void led_task_wrapper() {
-    static unsigned long lastToggle = 0;
     static bool state = LOW;
-    unsigned long currentMillis = millis();
-
-    if (currentMillis - lastToggle >= 100) {
-        state = !state;
-        digitalWrite(LED_BUILTIN, state);
-        lastToggle = currentMillis;
-    }
-}
\ No newline at end of file
+    state = !state;
+    hal_pin_write(LED_BUILTIN, state);
+}
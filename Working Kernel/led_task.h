@@ -4,4 +4,10 @@
 void setup_led();
 void led_task_wrapper();
 
+// Registry entry (task_registry.h): name, function, coroutine, period ms, priority, events, stack.
+// A plain function, so in preemptive mode it gets a stack of its own. It
+// toggles the LED once per job, so the default period of 100 ms is the
+// 5 Hz blink it used to time itself; -t sets another rate.
+#define LED_TASK(X) X("led", led_task_wrapper, NULL, 100, 10, 0, 128)
+
 #endif
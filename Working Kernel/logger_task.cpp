@@ -0,0 +1,20 @@
+#include "logger_task.h"
+#include "distance_task.h"
+#include "sensor_log.h"
+
+// Consumer side of distanceReadings: the slow SD writes happen here, at a
+// lower priority than sensing. Each job writes one batch and ends, so the
+// next one is released a period later and has a deadline like any other
+// task. A job that finds the channel empty sleeps until the distance task
+// publishes, but never past LOGGER_WAIT_MS.
+uint8_t logger_task_wrapper(Coroutine* co) {
+    CO_BEGIN(co);
+    CO_WAIT_EVENT_FOR(co, !distanceReadings.empty(), LOGGER_WAIT_MS);
+    // Read in place and free each slot once it is logged
+    const DistanceSample* sample;
+    while ((sample = distanceReadings.peek()) != NULL) {
+        sensor_log_record(sample->at, sample->cm);
+        distanceReadings.release();
+    }
+    CO_END(co);
+}
@@ -0,0 +1,21 @@
+#ifndef LOGGER_TASK_H
+#define LOGGER_TASK_H
+
+#include "coroutine.h"
+
+// Longest a job waits for a sample; under the period, so a job with
+// nothing to log still ends before its deadline
+#define LOGGER_WAIT_MS 250
+
+uint8_t logger_task_wrapper(Coroutine* co);
+
+// Registry entry (task_registry.h): name, function, coroutine, period ms, priority, events, stack.
+// No stack of its own, although its jobs are the longest (SD writes).
+// sensor_log holds preemption off through each record anyway, so a stack
+// would only let a task in between records, and the ~230 bytes it needs
+// (the SD call chain and the tick frame) are not left on an UNO in
+// preemptive mode. A job is bounded instead: it writes at most the
+// DISTANCE_CHANNEL_SIZE - 1 queued samples, about one cache line.
+#define LOGGER_TASK(X) X("logger", NULL, logger_task_wrapper, 500, 5, EVENT_BIT(EVENT_DISTANCE), 0)
+
+#endif
@@ -0,0 +1,324 @@
+#include "preempt.h"
+#if KERNEL_PREEMPTIVE
+#include "scheduler.h"
+#include "dispatch_queue.h"
+#include "hal.h"
+#if defined(__AVR_ARCH__)
+#include <avr/interrupt.h>
+#if defined(__AVR_3_BYTE_PC__)
+#error "preemptive mode supports 2-byte program counters only"
+#endif
+#elif defined(HAL_EXTERNAL)
+#include <ucontext.h>
+#include "host.h"
+#else
+#error "preemptive mode has an AVR and a host backend only"
+#endif
+
+// Only tasks with a stack get one, laid out in registry order
+#define PREEMPT_STACK_SUM(name, function, coroutine, period, priority, events, stack) +PREEMPT_STACK_BYTES(stack)
+#define PREEMPT_STACK_CHECK(name, function, coroutine, period, priority, events, stack) \
+    static_assert((stack) == 0 || (stack) >= PREEMPT_STACK_MIN, "task stack below PREEMPT_STACK_MIN");
+TASK_REGISTRY(PREEMPT_STACK_CHECK)
+#define PREEMPT_STACKS (0 TASK_REGISTRY(PREEMPT_STACK_SUM))
+
+static byte stacks[PREEMPT_STACKS > 0 ? PREEMPT_STACKS : 1];
+static bool live[TASK_COUNT];         // preempted mid-call, context on its stack
+static volatile int8_t current = -1;  // task on the CPU, -1 for the loop
+static volatile uint8_t exitStatus;   // why the last task gave the CPU back
+static volatile byte lockDepth = 0;
+static volatile bool pendingPreempt = false;
+static volatile byte sliceTicks = 0;
+
+// Timer tick, interrupts off, on the running stack
+static bool preempt_wanted() {
+    if (current < 0) return false;
+    if (sliceTicks < 255) sliceTicks++;
+    if (!dispatch_preempts(current, hal_millis(), sliceTicks >= PREEMPT_SLICE_TICKS)) return false;
+    if (lockDepth > 0) {
+        // Taken at preempt_unlock() instead
+        pendingPreempt = true;
+        return false;
+    }
+    return true;
+}
+
+unsigned int preempt_stack_size(int index) {
+    return PREEMPT_STACK_BYTES(pgm_read_byte(&taskRegistry[index].stack));
+}
+
+// Lowest byte of the task's stack; it grows down towards it
+static byte* stack_bottom(int index) {
+    byte* bottom = stacks;
+    for (int i = 0; i < index; i++) bottom += preempt_stack_size(i);
+    return bottom;
+}
+
+static bool canary_intact(int index) {
+    byte* bottom = stack_bottom(index);
+    for (byte i = 0; i < PREEMPT_CANARY_SIZE; i++) {
+        if (bottom[i] != PREEMPT_CANARY) return false;
+    }
+    return true;
+}
+
+static void preempt_trampoline();
+
+#if defined(__AVR_ARCH__)
+// The switch saves r0, SREG and r1..r31 on the running stack, exchanges
+// stack pointers through preemptSwitchSp and restores the other side.
+// Both the tick and a voluntary switch go through preempt_switch(), so
+// every saved context ends in a plain `ret` (into the ISR stub's `reti`
+// for a preempted task).
+#define SWITCH_NONE -2
+#define SWITCH_KERNEL -1
+
+extern "C" {
+volatile uint16_t preemptSwitchSp;
+void preempt_switch() __attribute__((naked, noinline, used));
+}
+static uint16_t kernelSp;
+static uint16_t taskSp[TASK_COUNT];
+static volatile int8_t switchTo = SWITCH_NONE;
+
+#define PREEMPT_SAVE_CONTEXT() asm volatile(                               \
+    "push r0\n\t" "in r0, __SREG__\n\t" "cli\n\t" "push r0\n\t"           \
+    "push r1\n\t" "clr r1\n\t"                                              \
+    "push r2\n\t" "push r3\n\t" "push r4\n\t" "push r5\n\t"                 \
+    "push r6\n\t" "push r7\n\t" "push r8\n\t" "push r9\n\t"                 \
+    "push r10\n\t" "push r11\n\t" "push r12\n\t" "push r13\n\t"             \
+    "push r14\n\t" "push r15\n\t" "push r16\n\t" "push r17\n\t"             \
+    "push r18\n\t" "push r19\n\t" "push r20\n\t" "push r21\n\t"             \
+    "push r22\n\t" "push r23\n\t" "push r24\n\t" "push r25\n\t"             \
+    "push r26\n\t" "push r27\n\t" "push r28\n\t" "push r29\n\t"             \
+    "push r30\n\t" "push r31\n\t"                                           \
+    "in r26, __SP_L__\n\t" "in r27, __SP_H__\n\t"                           \
+    "sts preemptSwitchSp, r26\n\t" "sts preemptSwitchSp+1, r27\n\t"         \
+    ::: "memory")
+
+#define PREEMPT_RESTORE_CONTEXT() asm volatile(                            \
+    "lds r26, preemptSwitchSp\n\t" "lds r27, preemptSwitchSp+1\n\t"         \
+    "out __SP_L__, r26\n\t" "out __SP_H__, r27\n\t"                         \
+    "pop r31\n\t" "pop r30\n\t" "pop r29\n\t" "pop r28\n\t"                 \
+    "pop r27\n\t" "pop r26\n\t" "pop r25\n\t" "pop r24\n\t"                 \
+    "pop r23\n\t" "pop r22\n\t" "pop r21\n\t" "pop r20\n\t"                 \
+    "pop r19\n\t" "pop r18\n\t" "pop r17\n\t" "pop r16\n\t"                 \
+    "pop r15\n\t" "pop r14\n\t" "pop r13\n\t" "pop r12\n\t"                 \
+    "pop r11\n\t" "pop r10\n\t" "pop r9\n\t" "pop r8\n\t"                   \
+    "pop r7\n\t" "pop r6\n\t" "pop r5\n\t" "pop r4\n\t"                     \
+    "pop r3\n\t" "pop r2\n\t" "pop r1\n\t"                                  \
+    "pop r0\n\t" "out __SREG__, r0\n\t" "pop r0\n\t"                        \
+    ::: "memory")
+
+// Runs between save and restore with interrupts off
+static void __attribute__((noinline)) preempt_select() {
+    int8_t to = switchTo;
+    if (to == SWITCH_NONE) {
+        if (!preempt_wanted()) return;
+        to = SWITCH_KERNEL;
+        exitStatus = CO_PREEMPTED;
+    }
+    switchTo = SWITCH_NONE;
+    if (to == SWITCH_KERNEL) {
+        taskSp[current] = preemptSwitchSp;
+        preemptSwitchSp = kernelSp;
+        current = -1;
+    } else {
+        kernelSp = preemptSwitchSp;
+        preemptSwitchSp = taskSp[to];
+        current = to;
+        sliceTicks = 0;
+        pendingPreempt = false;
+    }
+}
+
+void preempt_switch() {
+    PREEMPT_SAVE_CONTEXT();
+    preempt_select();
+    PREEMPT_RESTORE_CONTEXT();
+    asm volatile("ret");
+}
+
+ISR(TIMER1_COMPA_vect, ISR_NAKED) {
+    asm volatile("call preempt_switch\n\t" "reti");
+}
+
+// Must be entered with interrupts off; they are back on when it returns
+static void switch_to(int8_t to) {
+    switchTo = to;
+    preempt_switch();
+    sei();
+}
+
+// Fresh context: returns into the trampoline with interrupts on
+static void stack_frame_init(int index) {
+    byte* top = stack_bottom(index) + preempt_stack_size(index) - 1;
+    uint16_t entry = (uint16_t)preempt_trampoline;  // word address, as ret expects
+    *top-- = entry & 0xFF;
+    *top-- = entry >> 8;
+    *top-- = 0;     // r0
+    *top-- = 0x80;  // SREG, I set
+    for (byte r = 1; r < 32; r++) {
+        *top-- = 0;
+    }
+    taskSp[index] = (uint16_t)top;
+}
+
+static void timer_begin() {
+    // CTC on OCR1A, clk/64: one compare match per millisecond
+    TCCR1A = 0;
+    TCCR1B = _BV(WGM12) | _BV(CS11) | _BV(CS10);
+    OCR1A = F_CPU / 64 / 1000 - 1;
+    TCNT1 = 0;
+    TIMSK1 |= _BV(OCIE1A);
+}
+
+static void task_exit(uint8_t status) {
+    cli();
+    exitStatus = status;
+    switch_to(SWITCH_KERNEL);
+}
+
+static void task_yield() {
+    cli();
+    exitStatus = CO_PREEMPTED;
+    switch_to(SWITCH_KERNEL);
+}
+
+static void kernel_enter(int index) {
+    cli();
+    switch_to(index);
+}
+
+#else
+// Host: one ucontext per task. The tick is a host_at() callback on the
+// virtual clock, so like the AVR ISR it runs between two steps of the
+// task (a clock read, a wait, a device access) with interrupts off, and
+// switches from there: no signals, and the same run every time.
+#define HOST_PREEMPT_TICK_US 1000
+
+static ucontext_t kernelContext;
+static ucontext_t taskContext[TASK_COUNT];
+static unsigned long long nextTick;
+static uintptr_t tickChain;  // each timer_begin() starts a new one, older ticks stop
+
+static void host_tick(void* chain) {
+    if ((uintptr_t)chain != tickChain) return;
+    nextTick += HOST_PREEMPT_TICK_US;
+    if (nextTick <= host_now_us()) nextTick = host_now_us() + HOST_PREEMPT_TICK_US;
+    host_at(nextTick, host_tick, chain);
+    if (!preempt_wanted()) return;
+    int index = current;
+    exitStatus = CO_PREEMPTED;
+    current = -1;
+    // The task resumes here, and interrupts come back on as the callback returns
+    swapcontext(&taskContext[index], &kernelContext);
+}
+
+// A fresh context starts with interrupts on, as the AVR frame's SREG does
+static void host_task_start() {
+    hal_irq_restore(1);
+    preempt_trampoline();
+}
+
+static void stack_frame_init(int index) {
+    getcontext(&taskContext[index]);
+    taskContext[index].uc_stack.ss_sp = stack_bottom(index);
+    taskContext[index].uc_stack.ss_size = preempt_stack_size(index);
+    taskContext[index].uc_link = NULL;
+    makecontext(&taskContext[index], host_task_start, 0);
+}
+
+static void timer_begin() {
+    tickChain++;
+    nextTick = host_now_us() + HOST_PREEMPT_TICK_US;
+    host_at(nextTick, host_tick, (void*)tickChain);
+}
+
+static void task_exit(uint8_t status) {
+    hal_irq_save();
+    exitStatus = status;
+    current = -1;
+    setcontext(&kernelContext);
+}
+
+static void task_yield() {
+    hal_irq_save();
+    int index = current;
+    exitStatus = CO_PREEMPTED;
+    current = -1;
+    swapcontext(&taskContext[index], &kernelContext);
+    hal_irq_restore(1);
+}
+
+static void kernel_enter(int index) {
+    hal_irq_save();
+    current = index;
+    sliceTicks = 0;
+    pendingPreempt = false;
+    swapcontext(&kernelContext, &taskContext[index]);
+    hal_irq_restore(1);
+}
+#endif
+
+// Bottom of every task stack: one call into the task, then back to the loop
+static void preempt_trampoline() {
+    int index = current;
+    uint8_t status = scheduler_call(index);
+    live[index] = false;
+    task_exit(status);
+    for (;;) {
+    }
+}
+
+void preempt_init() {
+    memset(stacks, PREEMPT_CANARY, sizeof(stacks));
+    memset(live, 0, sizeof(live));
+    current = -1;
+    lockDepth = 0;
+    timer_begin();
+}
+
+uint8_t preempt_run(int index) {
+    // No stack of its own: run to completion here, as in cooperative mode
+    if (preempt_stack_size(index) == 0) return scheduler_call(index);
+    if (!live[index]) {
+        stack_frame_init(index);
+        live[index] = true;
+    }
+    kernel_enter(index);
+    if (!canary_intact(index)) {
+        live[index] = false;
+        return CO_OVERFLOW;
+    }
+    return exitStatus;
+}
+
+bool preempt_live(int index) {
+    return live[index];
+}
+
+void preempt_discard(int index) {
+    live[index] = false;
+}
+
+unsigned int preempt_stack_used(int index) {
+    byte* bottom = stack_bottom(index);
+    unsigned int size = preempt_stack_size(index);
+    unsigned int untouched = 0;
+    while (untouched < size && bottom[untouched] == PREEMPT_CANARY) untouched++;
+    return size - untouched;
+}
+
+void preempt_lock() {
+    lockDepth++;
+}
+
+void preempt_unlock() {
+    if (--lockDepth == 0 && pendingPreempt && current >= 0) {
+        pendingPreempt = false;
+        task_yield();
+    }
+}
+
+#endif
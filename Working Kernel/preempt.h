@@ -0,0 +1,90 @@
+#ifndef PREEMPT_H
+#define PREEMPT_H
+
+#include <Arduino.h>
+
+// Optional preemptive mode. Off (0), tasks run to completion on the main
+// stack as before. On (1), a task with a stack of its own (the last field
+// of its registry entry) runs on it, and a 1 ms timer tick takes the CPU
+// back from it when a better task is ready (higher priority, or earlier
+// deadline under EDF), or when its slice is over and a task of equal rank
+// is waiting. The loop then dispatches as usual and the preempted task
+// later resumes where it stopped. Only releases preempt: a task woken by an
+// event is made ready when the loop delivers the event, after the running
+// task ends or is preempted. A task with stack 0 runs to completion
+// on the loop's stack as in cooperative mode: it is never preempted, but
+// may run while another task is.
+//
+// Switched on with KERNEL_PREEMPTIVE in kernel_config.h.
+//
+// Backends: AVR uses Timer1 compare A (no PWM on pins 9/10, no Servo);
+// a host build uses ucontext, with the tick on the virtual clock (host.h).
+//
+// A preempted task can stop anywhere, so whatever it shares with the loop
+// or another task must not be left half updated:
+// - klog, sensor_log and the filesystem (its cache, the SD library and
+//   the SPI bus) hold preemption off with preempt_lock()/preempt_unlock()
+//   while they work.
+// - Events and channels are posted with interrupts off (event_signal()).
+// - Only the loop uses the event ring's consumer side, the swap log, the
+//   snapshot, the EEPROM/I2C bus, the Bluetooth link and Serial; tasks
+//   must not call them (print through klog).
+// Anything else a task shares needs the same lock.
+#include "kernel_config.h"
+#include "hal.h"
+#if KERNEL_PREEMPTIVE && HAL_TICKLESS
+#error "Preemptive mode and tickless idle both need Timer1: build without HAL_TICKLESS"
+#endif
+
+#define PREEMPT_SLICE_TICKS 4  // 1 ms ticks a task may hold the CPU against an equal
+#define PREEMPT_CANARY 0xA5    // stacks are filled with it to measure use
+#define PREEMPT_CANARY_SIZE 8  // bottom bytes that must stay untouched
+// Smallest stack a registry entry may ask for: the canary, the tick (ISR
+// entry, 33 saved registers and the calls that pick the next task, about
+// 64 bytes) and the trampoline. The task's own call chain comes on top.
+#define PREEMPT_STACK_MIN 80
+// Registry stacks are AVR bytes; a host build gives each of them room for
+// C library calls and the simulated devices instead
+#if defined(__AVR_ARCH__)
+#define PREEMPT_STACK_BYTES(stack) (stack)
+#else
+#define PREEMPT_STACK_BYTES(stack) ((stack) ? 65536U : 0U)
+#endif
+
+// Returned by preempt_run() besides the CO_* statuses
+#define CO_PREEMPTED 5  // slice taken away, the task resumes on its stack
+#define CO_OVERFLOW 6   // the task's stack canary was overwritten
+
+#if KERNEL_PREEMPTIVE
+
+void preempt_init();
+// Runs (or resumes) the task on its stack until it returns or is preempted
+uint8_t preempt_run(int index);
+// True while the task is preempted mid-call
+bool preempt_live(int index);
+// Drops a preempted call, for a task removed mid-call
+void preempt_discard(int index);
+// Size of the task's own stack, 0 if it runs on the loop's
+unsigned int preempt_stack_size(int index);
+// Highest stack use seen, in bytes
+unsigned int preempt_stack_used(int index);
+
+void preempt_lock();
+void preempt_unlock();
+
+#else
+
+inline bool preempt_live(int) { return false; }
+inline void preempt_discard(int) {}
+inline void preempt_lock() {}
+inline void preempt_unlock() {}
+
+#endif
+
+// Holds preemption off for the rest of the enclosing scope
+struct PreemptGuard {
+    PreemptGuard() { preempt_lock(); }
+    ~PreemptGuard() { preempt_unlock(); }
+};
+
+#endif
@@ -0,0 +1,87 @@
+#include "ranging.h"
+#include "hal.h"
+#include "events.h"
+#if defined(__AVR_ATmega328P__)
+#include <avr/interrupt.h>
+#endif
+
+static int trigPin;
+static int echoPin;
+
+static volatile bool armed = false;
+static volatile unsigned long echoRise = 0;
+// Single-slot mailbox: the ISR writes echoWidth, then bumps echoSeq
+static volatile unsigned int echoWidth = 0;
+static volatile byte echoSeq = 0;
+
+static byte consumedSeq = 0;
+static unsigned long triggerTime = 0;
+static unsigned int lastEcho = 0;
+
+static void echo_edge() {
+    unsigned long now = hal_micros();
+    if (!armed) return;
+    if (hal_pin_read(echoPin)) {
+        echoRise = now;
+    } else if (echoRise != 0) {
+        echoWidth = now - echoRise;
+        echoSeq++;
+        armed = false;
+        event_post(EVENT_ECHO, 0);
+    }
+}
+
+#if defined(__AVR_ATmega328P__)
+// Pins 8-13 share PCINT0; only the echo pin is unmasked
+ISR(PCINT0_vect) {
+    echo_edge();
+}
+#endif
+
+void ranging_begin(int trig, int echo) {
+    trigPin = trig;
+    echoPin = echo;
+    hal_pin_output(trigPin);
+    hal_pin_input(echoPin, false);
+#if defined(__AVR_ATmega328P__)
+    *digitalPinToPCMSK(echoPin) |= _BV(digitalPinToPCMSKbit(echoPin));
+    PCICR |= _BV(digitalPinToPCICRbit(echoPin));
+#else
+    hal_pin_on_change(echoPin, echo_edge);
+#endif
+}
+
+void ranging_trigger() {
+    echoRise = 0;
+    consumedSeq = echoSeq;
+    armed = true;
+    triggerTime = hal_micros();
+    hal_pin_write(trigPin, false);
+    hal_delay_us(2);
+    hal_pin_write(trigPin, true);
+    hal_delay_us(10);
+    hal_pin_write(trigPin, false);
+}
+
+bool ranging_done() {
+    if (echoSeq != consumedSeq) {
+        // Re-read if the ISR published while we copied the 16-bit width
+        byte seq;
+        do {
+            seq = echoSeq;
+            lastEcho = echoWidth;
+        } while (seq != echoSeq);
+        consumedSeq = seq;
+        return true;
+    }
+    if (armed && hal_micros() - triggerTime >= RANGING_TIMEOUT_US) {
+        armed = false;
+        lastEcho = 0;
+        return true;
+    }
+    return !armed;
+}
+
+unsigned int ranging_echo_us() {
+    return lastEcho;
+}
@@ -0,0 +1,25 @@
+#ifndef RANGING_H
+#define RANGING_H
+
+#include <Arduino.h>
+
+// Interrupt-driven HC-SR04 ranging. ranging_trigger() fires the pulse and
+// returns; the echo edges are timestamped in a pin-change ISR and the width
+// is published to a single-slot mailbox that ranging_done() reads, and
+// EVENT_ECHO is posted so a waiting task is woken rather than polling.
+
+#define RANGING_TIMEOUT_US 30000UL  // no echo within this is "out of range" (~5 m)
+
+void ranging_begin(int trigPin, int echoPin);
+void ranging_trigger();
+// True once the echo arrived or the measurement timed out
+bool ranging_done();
+// Echo width in microseconds of the last measurement, 0 on timeout
+unsigned int ranging_echo_us();
+
+// Round trip at 343 m/s is 0.017 cm/us, in 16.16 fixed point
+inline unsigned int ranging_us_to_cm(unsigned int echoUs) {
+    return (unsigned int)(((unsigned long)echoUs * 1114UL) >> 16);
+}
+
+#endif
@@ -1,169 +1,329 @@
 
 #include "scheduler.h"
-#include "eeprom.h"
-#include "filesystem.h"
+#include "swap_store.h"
+#include "snapshot.h"
+#include "hal.h"
 #include "bluetooth_transfer.h"
-#include <Wire.h>
+#include "commands.h"
+#include "dispatch_queue.h"
+#include "idle.h"
+#include "klog.h"
+#include "task_stats.h"
+#include "preempt.h"
+#include "events.h"
+#include "admission.h"
 #include <string.h>
+#include <stddef.h>
 
-ScheduledTask taskList[MAX_REGISTERED_TASKS];
-int taskCount = 0;
+ScheduledTask taskList[TASK_COUNT];
+SwapStats swapStats;
 int activeTaskCount = 0;
 bool isPaused = false;
 char commandBuffer[CMD_BUFFER_SIZE];
 
+// Records hold a task as it is while resident, whatever state it was
+// written from, so swap_clean() can match the image swap-out sees
+static void swap_image(int index, ScheduledTask* image) {
+    *image = taskList[index];
+    image->active = true;
+    image->swapped = false;
+}
+
+// Append the task's current state to the swap log
+static void swap_write(int index) {
+    ScheduledTask image;
+    swap_image(index, &image);
+    swap_store_write(index, &image);
+    snapshot_mark_dirty();
+}
+
+// The newest record already holds this image. Reading it back costs less
+// than a page write and no RAM copy of every image is kept for the check.
+static bool swap_clean(int index) {
+    ScheduledTask image;
+    ScheduledTask stored;
+    swap_image(index, &image);
+    return swap_store_read(index, &stored) && memcmp(&stored, &image, sizeof(ScheduledTask)) == 0;
+}
+
+// The admitted set changed; save it now rather than on the next interval
+static void save_snapshot() {
+    if (!snapshot_save()) {
+        Serial.println(F("Snapshot write failed."));
+    }
+}
+
+// The task table is in flash, so there is nothing to register here
 void scheduler_init() {
-    taskCount = 0;
+    memset(taskList, 0, sizeof(taskList));
+    swap_store_init();
     activeTaskCount = 0;
     isPaused = false;
     memset(commandBuffer, 0, CMD_BUFFER_SIZE);
+    memset(&swapStats, 0, sizeof(swapStats));
+    task_stats_reset();
+    dispatch_init();
+    events_init();
+#if KERNEL_PREEMPTIVE
+    preempt_init();
+#endif
 }
 
 bool isSchedulerRunning() {
     return !isPaused;
 }
 
-void scheduler_register_task(const char* name, TaskFunction function) {
-    if (taskCount < MAX_REGISTERED_TASKS) {
-        strncpy(taskList[taskCount].name, name, 9);
-        taskList[taskCount].name[9] = '\0'; // Ensure null-termination
-        taskList[taskCount].function = function;
-        taskList[taskCount].duration = DEFAULT_DURATION;
-        taskList[taskCount].startTime = 0;
-        taskList[taskCount].endTime = 0;
-        taskList[taskCount].priority = 0;
-        taskList[taskCount].active = false;
-        taskList[taskCount].swapped = false;
-        taskCount++;
-    }
+const __FlashStringHelper* scheduler_task_name(int index) {
+    return reinterpret_cast<const __FlashStringHelper*>(taskRegistry[index].name);
 }
 
-void scheduler_add_task(const char* name, unsigned long duration, int priority) {
-    int regIndex = -1;
-    for (int i = 0; i < taskCount; i++) {
-        if (strcmp(taskList[i].name, name) == 0) {
-            regIndex = i;
-            break;
+// Free a RAM slot by swapping out the lowest-priority resident task
+static bool swap_out_lowest(int keepIndex) {
+    int lowestIndex = -1;
+    int lowestPriority = 99999;
+    for (int i = 0; i < TASK_COUNT; i++) {
+        if (i != keepIndex && taskList[i].active && taskList[i].priority < lowestPriority) {
+            lowestPriority = taskList[i].priority;
+            lowestIndex = i;
         }
     }
+    if (lowestIndex == -1) return false;
+    swap_out_task(lowestIndex);
+    activeTaskCount--;  // one active task removed
+    return true;
+}
+
+void scheduler_add_task(const char* name, unsigned long duration, int priority, bool force) {
+    int regIndex = task_registry_find(name);
     if (regIndex == -1) {
         Serial.print(F("Task function not found for: "));
         Serial.println(name);
         return;
     }
-    taskList[regIndex].duration = duration;
-    taskList[regIndex].priority = priority;
-    if (taskList[regIndex].active) {
+    if (duration > TASK_MAX_PERIOD_MS) {
+        Serial.print(F("Period too long, max ms: "));
+        Serial.println(TASK_MAX_PERIOD_MS);
+        return;
+    }
+    uint16_t period = (duration + TASK_TICK_MS - 1) / TASK_TICK_MS;
+    if (!admission_admit(regIndex, period, priority, force)) return;
+    ScheduledTask* task = &taskList[regIndex];
+    if (task->active || task->swapped) {
+        // Re-key the queued task so the dispatch heaps stay ordered
+        dispatch_remove(regIndex);
+        task->period = period;
+        task->priority = priority;
+        if (task->swapped) swap_write(regIndex);
+        dispatch_insert(regIndex);
+        save_snapshot();
         Serial.print(F("Task already active: "));
         Serial.println(name);
         return;
     }
-    // If there is free RAM slot, mark task as active
-    if (activeTaskCount < MAX_TASKS) {
-        taskList[regIndex].active = true;
-        taskList[regIndex].swapped = false;
-        taskList[regIndex].startTime = 0;
-        activeTaskCount++;
-        Serial.print(F("Added task: "));
+    // Memory is full; choose the lowest-priority active task to swap out
+    if (activeTaskCount >= MAX_TASKS) {
+        Serial.println(F("Memory Full: Swapping out the lowest priority task..."));
+        if (!swap_out_lowest(regIndex)) {
+            Serial.println(F("No active task available to swap out."));
+            return;
+        }
+    }
+    task->period = period;
+    task->priority = priority;
+    task->active = true;
+    task->swapped = false;
+    task->co.resume = 0;
+    // First release is immediate, then every period
+    task->startTime = hal_millis();
+    activeTaskCount++;
+    dispatch_insert(regIndex);
+    save_snapshot();
+    Serial.print(F("Added task: "));
+    Serial.println(name);
+}
+
+void scheduler_remove_task(const char* name) {
+    int i = task_registry_find(name);
+    if (i == -1) {
+        Serial.println(F("Task not found."));
+        return;
+    }
+    if (taskList[i].active || taskList[i].swapped) {
+        dispatch_remove(i);
+        preempt_discard(i);
+        events_unblock(i);
+        if (taskList[i].active) activeTaskCount--;
+        taskList[i].active = false;
+        taskList[i].swapped = false;
+        save_snapshot();
+        Serial.print(F("Removing task: "));
         Serial.println(name);
     } else {
-        // Memory is full; choose the lowest-priority active task to swap out
-        int lowestIndex = -1;
-        int lowestPriority = 99999;
-        for (int i = 0; i < taskCount; i++) {
-            if (taskList[i].active && taskList[i].priority < lowestPriority) {
-                lowestPriority = taskList[i].priority;
-                lowestIndex = i;
-            }
-        }
-        if (lowestIndex != -1) {
-            Serial.println(F("Memory Full: Swapping out the lowest priority task..."));
-            swap_out_task(lowestIndex);
-            activeTaskCount--;  // one active task removed
-            // Activate the new task
-            taskList[regIndex].active = true;
-            taskList[regIndex].swapped = false;
-            taskList[regIndex].startTime = 0;
+        Serial.print(F("Task not active: "));
+        Serial.println(name);
+    }
+}
+
+int scheduler_readmit() {
+    unsigned long now = hal_millis();
+    int admitted = 0;
+    activeTaskCount = 0;
+    dispatch_init();
+    for (int i = 0; i < TASK_COUNT; i++) {
+        ScheduledTask* task = &taskList[i];
+        if (!task->active && !task->swapped) continue;
+        task->startTime = now;
+        task->co.resume = 0;
+        task->co.wakeAt = 0;
+        events_unblock(i);
+        if (task->active) {
             activeTaskCount++;
-            Serial.print(F("Added task: "));
-            Serial.println(name);
         } else {
-            Serial.println(F("No active task available to swap out."));
+            // Its last record still holds times from before the reset
+            swap_write(i);
         }
+        dispatch_insert(i);
+        admitted++;
     }
+    return admitted;
 }
 
-void scheduler_remove_task(const char* name) {
-    for (int i = 0; i < taskCount; i++) {
-        if (strcmp(taskList[i].name, name) == 0) {
-            if (taskList[i].active) {
-                taskList[i].active = false;
-                taskList[i].swapped = false;
-                activeTaskCount--;
-                Serial.print(F("Removing task: "));
-                Serial.println(name);
-            } else {
-                Serial.print(F("Task not active: "));
-                Serial.println(name);
-            }
-            return;
-        }
+uint8_t scheduler_call(int index) {
+    CoroutineFunction coroutine = (CoroutineFunction)pgm_read_ptr(&taskRegistry[index].coroutine);
+    if (coroutine != NULL) {
+        return coroutine(&taskList[index].co);
     }
-    Serial.println(F("Task not found."));
+    ((TaskFunction)pgm_read_ptr(&taskRegistry[index].function))();
+    return CO_ENDED;
 }
 
 void scheduler_run() {
-    if (isPaused || taskCount == 0) return;
-    unsigned long currentMillis = millis();
-    static int currentTaskIndex = 0;
-    if (currentTaskIndex >= taskCount) currentTaskIndex = 0;
-    ScheduledTask* task = &taskList[currentTaskIndex];
+    if (isPaused) return;
+    // Wake event subscribers before choosing, so they can run this pass
+    events_dispatch();
+    unsigned long currentMillis = hal_millis();
+    int index = dispatch_next(currentMillis);
+    if (index < 0) return;
+    ScheduledTask* task = &taskList[index];
+    // However it was released (event, fallback time, period), it no longer waits
+    events_unblock(index);
 
-    // If the task is marked swapped, swap it in first
-    if (!task->active && task->swapped) {
-        swap_in_task(currentTaskIndex);
+    // A released task that lives in EEPROM is brought back into RAM first
+    if (task->swapped) {
+        if (activeTaskCount >= MAX_TASKS && !swap_out_lowest(index)) {
+            // No resident task to make room with: leave it in EEPROM and
+            // try again later. Swap-in restores the stored times, so the
+            // job keeps its release and deadline.
+            klog_task(KLOG_SWAP_NO_ROOM, index);
+            if (task->co.resume != 0) {
+                task->co.wakeAt = currentMillis + SWAP_IN_RETRY_MS;
+            } else {
+                task->startTime = currentMillis + SWAP_IN_RETRY_MS;
+            }
+            dispatch_insert(index);
+            return;
+        }
+        swap_in_task(index);
         activeTaskCount++;
     }
-    // If first run in this cycle, set start/end times
-    if (task->startTime == 0) {
-        task->startTime = currentMillis;
-        task->endTime = currentMillis + task->duration;
-    }
     // Execute the task function
-    task->function();
-    // If the task's time slot is over, cycle it out
-    if (currentMillis >= task->endTime) {
-        Serial.print(F("Cycling out task: "));
-        Serial.println(task->name);
-        swap_out_task(currentTaskIndex);
+    bool jobStart = task->co.resume == 0 && !preempt_live(index);
+    unsigned long began = hal_micros();
+#if KERNEL_PREEMPTIVE
+    uint8_t status = preempt_run(index);
+#else
+    uint8_t status = scheduler_call(index);
+#endif
+    unsigned long execUs = hal_micros() - began;
+    if (status == CO_OVERFLOW) {
+        // Whatever lies below its stack may be damaged; never run it again
+        klog_task(KLOG_STACK_OVERFLOW, index);
+        events_unblock(index);
+        task->active = false;
         activeTaskCount--;
-        // Move to next task in round-robin order
-        currentTaskIndex = (currentTaskIndex + 1) % taskCount;
-        // For the new current task, if it's swapped, swap it in
-        if (taskList[currentTaskIndex].swapped) {
-            swap_in_task(currentTaskIndex);
-            activeTaskCount++;
+        save_snapshot();
+        return;
+    }
+    task_stats_run(index, execUs,
+                   jobStart ? (long)(currentMillis - task->startTime) : -1,
+                   status == CO_ENDED,
+                   status == CO_ENDED && (long)(hal_millis() - task_deadline(task)) > 0);
+    if (status == CO_YIELDED || status == CO_PREEMPTED) {
+        task->co.wakeAt = currentMillis;
+    } else if (status == CO_WAITING) {
+        task->co.wakeAt = currentMillis + CO_POLL_INTERVAL;
+    } else if (status == CO_ENDED) {
+        // Next release is one period later; if that is already past, restart from now
+        unsigned long period = task_period_ms(task);
+        if ((long)(currentMillis - task->startTime) >= (long)period) {
+            task->startTime = currentMillis;
+        } else {
+            task->startTime += period;
         }
-        // Reset its timing for a new cycle
-        taskList[currentTaskIndex].startTime = 0;
     }
+    if (status == CO_EVENT) events_block(index);
+    // CO_SLEEPING and CO_EVENT already set co.wakeAt
+    dispatch_insert(index);
+}
+
+// Sleep until the next release; while paused only a command can wake us.
+// Log output is the lowest-priority work and is only emitted from here.
+void scheduler_idle() {
+    // Also drains the queue while paused, or pending events keep us awake
+    events_dispatch();
+    klog_drain();
+    swap_store_idle();
+    snapshot_idle();
+    unsigned long nextRelease = 0;
+    bool timed = !isPaused && dispatch_next_release(&nextRelease);
+    idle_sleep_until(timed, nextRelease);
 }
 
 void scheduler_inspect() {
     isPaused = true;
     Serial.println(F("\n--- Task List ---"));
-    for (int i = 0; i < taskCount; i++) {
+    for (int i = 0; i < TASK_COUNT; i++) {
         Serial.print(F("Name: "));
-        Serial.print(taskList[i].name);
+        Serial.print(scheduler_task_name(i));
         Serial.print(F(" | Duration: "));
-        Serial.print(taskList[i].duration);
+        Serial.print(task_period_ms(&taskList[i]));
         Serial.print(F("ms | Priority: "));
         Serial.print(taskList[i].priority);
         Serial.print(F(" | Active: "));
         Serial.print(taskList[i].active ? F("Yes") : F("No"));
         Serial.print(F(" | Swapped: "));
+#if KERNEL_PREEMPTIVE
+        Serial.print(taskList[i].swapped ? F("Yes") : F("No"));
+        Serial.print(F(" | Stack: "));
+        if (preempt_stack_size(i) == 0) {
+            Serial.println(F("loop"));
+        } else {
+            Serial.print(preempt_stack_used(i));
+            Serial.print('/');
+            Serial.println(preempt_stack_size(i));
+        }
+#else
         Serial.println(taskList[i].swapped ? F("Yes") : F("No"));
+#endif
     }
+    Serial.print(F("Swaps out: "));
+    Serial.print(swapStats.swapOuts);
+    Serial.print(F(" (clean "));
+    Serial.print(swapStats.cleanSwapOuts);
+    Serial.print(F(") | in: "));
+    Serial.print(swapStats.swapIns);
+    Serial.print(F(" | EEPROM bytes written: "));
+    Serial.print(swapStats.bytesWritten);
+    Serial.print(F(" saved by clean swap-outs: "));
+    Serial.println(swapStats.cleanBytesSaved);
+    swap_store_print();
+    Serial.print(F("Idle: "));
+    Serial.print(idleStats.sleeps);
+    Serial.print(F(" sleeps | "));
+    Serial.print(idleStats.wakeups);
+    Serial.print(F(" wakeups | "));
+    Serial.print(idleStats.idleMillis);
+    Serial.println(F("ms asleep"));
     Serial.println(F("-----------------"));
 }
 
@@ -172,113 +332,12 @@ void scheduler_handle_command() {
     if (btTransferActive) return;
 
     static int bufferIndex = 0;
-    while (Serial.available() > 0) {
-        char c = Serial.read();
+    while (hal_console_available() > 0) {
+        char c = hal_console_read();
         if (c == '\n' || bufferIndex >= CMD_BUFFER_SIZE - 1) {
             commandBuffer[bufferIndex] = '\0';
             bufferIndex = 0;
-            char cmd[10];
-            char taskName[20];
-            unsigned long duration = DEFAULT_DURATION;
-            int priority = -1;
-            
-            sscanf(commandBuffer, "%s", cmd);
-            
-            // Command branches
-            if (strcmp(cmd, "start") == 0) {
-                isPaused = false;
-                Serial.println(F("Scheduler started."));
-            } 
-            else if (strcmp(cmd, "stop") == 0) {
-                isPaused = true;
-                Serial.println(F("Scheduler stopped."));
-            }
-            else if (strcmp(cmd, "exec") == 0) {
-                if (isSchedulerRunning()) {
-                    char* ptr = commandBuffer + 5;
-                    sscanf(ptr, "%s", taskName);
-                    char* param = strtok(ptr, " ");
-                    while ((param = strtok(NULL, " ")) != NULL) {
-                        if (strcmp(param, "-t") == 0) {
-                            duration = atol(strtok(NULL, " "));
-                        } else if (strcmp(param, "-p") == 0) {
-                            priority = atoi(strtok(NULL, " "));
-                        }
-                    }
-                    if (priority == -1) {
-                        priority = 10;
-                    }
-                    scheduler_add_task(taskName, duration, priority);
-                } else {
-                    Serial.println(F("Scheduler is stopped. Use 'start' to run the scheduler."));
-                }
-            } 
-            else if (strcmp(cmd, "halt") == 0) {
-                if (isSchedulerRunning()) {
-                    sscanf(commandBuffer + 5, "%s", taskName);
-                    scheduler_remove_task(taskName);
-                } else {
-                    Serial.println(F("Scheduler is stopped. Use 'start' to run the scheduler."));
-                }
-            } 
-
-            else if (strcmp(cmd, "BTDIAG") == 0) {
-              if (isSchedulerRunning()) {
-                Serial.println(F("Stop the scheduler before Bluetooth diagnostics."));
-              } else {
-                bt_diagnostic();
-              }
-            }
-
-            else if (strcmp(cmd, "inspect") == 0) {
-                scheduler_inspect();
-            }
-            else if (strcmp(cmd, "CREATE") == 0) {
-                if (!isSchedulerRunning()) {
-                    char filename[20];
-                    if (sscanf(commandBuffer + 7, "%19s", filename) == 1) {
-                        createFile(filename);
-                    }
-                } else {
-                    Serial.println(F("Scheduler is running. Use 'stop' before file operations."));
-                }
-            }
-            else if (strcmp(cmd, "DELETE") == 0) {
-                if (!isSchedulerRunning()) {
-                    char filename[20];
-                    if (sscanf(commandBuffer + 7, "%19s", filename) == 1) {
-                        deleteFile(filename);
-                    }
-                } else {
-                    Serial.println(F("Scheduler is running. Use 'stop' before file operations."));
-                }
-            }
-            else if (strcmp(cmd, "VIEW") == 0) {
-                listFiles();
-            }
-            // New Bluetooth file transfer commands
-            else if (strcmp(cmd, "BTGET") == 0) {
-                if (isSchedulerRunning()) {
-                    Serial.println(F("Stop the scheduler before Bluetooth file operations."));
-                } else {
-                    bt_receive_file();
-                }
-            }
-            else if (strcmp(cmd, "BTSEND") == 0) {
-                if (isSchedulerRunning()) {
-                    Serial.println(F("Stop the scheduler before Bluetooth file operations."));
-                } else {
-                    char filename[20];
-                    if (sscanf(commandBuffer + 7, "%19s", filename) == 1) {
-                        bt_send_file(filename);
-                    } else {
-                        Serial.println(F("Please specify a filename to send."));
-                    }
-                }
-            }
-            else {
-                Serial.println(F("Invalid command!"));
-            }
+            command_execute(commandBuffer);
             memset(commandBuffer, 0, CMD_BUFFER_SIZE);
         } else {
             commandBuffer[bufferIndex++] = c;
@@ -287,26 +346,33 @@ void scheduler_handle_command() {
 }
 
 void swap_out_task(int index) {
-    unsigned int address = 0x0000 + (index * sizeof(ScheduledTask));
-    byte* taskData = (byte*)&taskList[index];
-    for (int i = 0; i < sizeof(ScheduledTask); i++) {
-        writeEEPROM(address + i, taskData[i]);
-        delay(5);  // ensure write completion
+    unsigned long began = hal_micros();
+    swapStats.swapOuts++;
+    if (swap_clean(index)) {
+        // The newest record is already current
+        swapStats.cleanSwapOuts++;
+        swapStats.cleanBytesSaved += sizeof(ScheduledTask);
+    } else {
+        swap_write(index);
     }
     taskList[index].swapped = true;
     taskList[index].active = false;
-    Serial.print(F("Swapped out task: "));
-    Serial.println(taskList[index].name);
+    task_stats_swap(index, false, hal_micros() - began);
+    klog_task(KLOG_SWAP_OUT, index);
 }
 
 void swap_in_task(int index) {
-    unsigned int address = 0x0000 + (index * sizeof(ScheduledTask));
-    byte* taskData = (byte*)&taskList[index];
-    for (int i = 0; i < sizeof(ScheduledTask); i++) {
-        taskData[i] = readEEPROM(address + i);
+    ScheduledTask image;
+    unsigned long began = hal_micros();
+    swapStats.swapIns++;
+    // Read into a scratch copy so a bus error leaves the RAM copy intact
+    if (swap_store_read(index, &image)) {
+        taskList[index] = image;
+    } else {
+        klog_task(KLOG_SWAP_READ_FAIL, index);
     }
     taskList[index].swapped = false;
     taskList[index].active = true;
-    Serial.print(F("Swapped in task: "));
-    Serial.println(taskList[index].name);
+    task_stats_swap(index, true, hal_micros() - began);
+    klog_task(KLOG_SWAP_IN, index);
 }
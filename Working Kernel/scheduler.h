@@ -46,38 +46,77 @@
 #define SCHEDULER_H
 
 #include <Arduino.h>
+#include "coroutine.h"
+#include "kernel_config.h"
+#include "task_registry.h"
 
-// Maximum number of tasks allowed simultaneously in RAM
-#define MAX_TASKS 3
-// Maximum tasks that can be registered overall (active + swapped)
-#define MAX_REGISTERED_TASKS 5
-#define CMD_BUFFER_SIZE 50
-#define DEFAULT_DURATION 3000
+// MAX_TASKS (kernel_config.h) tasks are allowed in RAM at once; every task
+// in the registry (TASK_COUNT) has a slot whether resident or swapped
+static_assert(MAX_TASKS >= 1 && MAX_TASKS <= 255, "MAX_TASKS must be 1..255");
+// A released task that finds no resident task to swap out for it is
+// retried this many ms later
+#define SWAP_IN_RETRY_MS 100
+#define CMD_BUFFER_SIZE 40  // longest line: exec <name> -t <ms> -p <prio> -f
 
-typedef void (*TaskFunction)();
+// Dispatch policy for released tasks, chosen at compile time with
+// SCHED_POLICY (kernel_config.h)
+#define SCHED_FIXED_PRIORITY 0  // highest priority first
+#define SCHED_EDF 1             // earliest deadline (startTime + period) first
 
+// Periods are stored in 16 bits as ticks of TASK_TICK_MS (kernel_config.h);
+// a coarser tick allows longer periods (65535 ticks max) at lower resolution.
+#define TASK_MAX_PERIOD_MS (65535UL * TASK_TICK_MS)
+// Priorities are 0..TASK_MAX_PRIORITY, so they fit a 16-bit int
+#define TASK_MAX_PRIORITY 32767
+
+// Run-time state of taskRegistry[i] lives in taskList[i]; name and entry
+// point stay in flash. Swap out appends it to the swap log (swap_store.h).
 struct ScheduledTask {
-    char name[10];           // Reduced from 20 to 10
-    TaskFunction function;
-    unsigned long duration;
-    unsigned long startTime;
-    unsigned long endTime;
+    uint16_t period;         // release period in TASK_TICK_MS ticks
+    unsigned long startTime; // current release; the deadline is one period later
     int priority;
-    bool active;
-    bool swapped;
+    uint8_t active : 1;
+    uint8_t swapped : 1;
+    Coroutine co;            // resume point of a coroutine task
+};
+
+inline unsigned long task_period_ms(const ScheduledTask* task) {
+    return (unsigned long)task->period * TASK_TICK_MS;
+}
+
+inline unsigned long task_deadline(const ScheduledTask* task) {
+    return task->startTime + task_period_ms(task);
+}
+
+// EEPROM swap traffic counters
+struct SwapStats {
+    unsigned long swapOuts;
+    unsigned long cleanSwapOuts;  // swap outs that needed no EEPROM write
+    unsigned long swapIns;
+    unsigned long bytesWritten;
+    unsigned long cleanBytesSaved;  // image bytes clean swap outs did not write
+    unsigned long flushes;        // staged swap records written as a batch
 };
 
-extern ScheduledTask taskList[MAX_REGISTERED_TASKS];
-extern int taskCount;
+extern ScheduledTask taskList[TASK_COUNT];
+extern SwapStats swapStats;
 extern int activeTaskCount;
 extern bool isPaused;
 extern char commandBuffer[CMD_BUFFER_SIZE];
 
 void scheduler_init();
-void scheduler_register_task(const char* name, TaskFunction function);
-void scheduler_add_task(const char* name, unsigned long duration, int priority);
+const __FlashStringHelper* scheduler_task_name(int index);
+// Admits the task or re-keys it if already admitted, after admission
+// control (admission.h) unless force is set
+void scheduler_add_task(const char* name, unsigned long duration, int priority, bool force);
 void scheduler_remove_task(const char* name);
+// Admits again every task taskList marks active or swapped (after a
+// snapshot restore): released now, jobs start from the top. Returns the count.
+int scheduler_readmit();
+// Calls the task's function or coroutine once, returns its CO_* status
+uint8_t scheduler_call(int index);
 void scheduler_run();
+void scheduler_idle();
 void scheduler_inspect();
 void scheduler_handle_command();
 void swap_out_task(int index);
@@ -0,0 +1,102 @@
+#include "sensor_log.h"
+#include "filesystem.h"
+#include "preempt.h"
+
+static FsFile logFile = FS_NO_FILE;
+static bool sessionStarted = false;
+static unsigned long lastStamp = 0;
+
+static bool log_open() {
+    // Also reopens after the card was remounted
+    if (fs_is_open(logFile)) return true;
+    logFile = fs_open(SENSOR_LOG_FILE, FS_WRITE);
+    return logFile != FS_NO_FILE;
+}
+
+// Append one record; it waits in an fs cache line until the line fills
+static void log_push(uint16_t deltaMs, uint16_t value) {
+    if (!log_open()) return;  // no card, drop the sample
+    SensorRecord record = { deltaMs, value };
+    unsigned long before = fs_length(logFile);
+    if (fs_append(logFile, &record, sizeof(record)) != sizeof(record)) return;
+    // Commit the directory entry once per completed sector
+    if (before / SENSOR_LOG_SECTOR != fs_length(logFile) / SENSOR_LOG_SECTOR) {
+        fs_sync(logFile);
+    }
+}
+
+void sensor_log_record(unsigned long now, uint16_t value) {
+    preempt_lock();
+    if (!sessionStarted) {
+        log_push(SENSOR_LOG_SESSION, now >> 16);
+        log_push(SENSOR_LOG_SESSION, now & 0xFFFF);
+        lastStamp = now;
+        sessionStarted = true;
+    }
+    unsigned long delta = now - lastStamp;
+    while (delta >= SENSOR_LOG_SESSION) {
+        uint16_t gap = delta > 0xFFFF ? 0xFFFF : delta;
+        log_push(SENSOR_LOG_GAP, gap);
+        delta -= gap;
+    }
+    log_push(delta, value);
+    lastStamp = now;
+    preempt_unlock();
+}
+
+void sensor_log_flush() {
+    if (logFile != FS_NO_FILE) {
+        fs_close(logFile);
+        logFile = FS_NO_FILE;
+    }
+}
+
+bool sensor_log_export_csv() {
+    sensor_log_flush();
+    FsFile in = fs_open(SENSOR_LOG_FILE, FS_READ);
+    if (in == FS_NO_FILE) {
+        Serial.println(F("No sensor log to export."));
+        return false;
+    }
+    fs_remove(SENSOR_LOG_CSV);
+    FsFile outFile = fs_open(SENSOR_LOG_CSV, FS_WRITE);
+    if (outFile == FS_NO_FILE) {
+        fs_close(in);
+        Serial.println(F("Could not create CSV file."));
+        return false;
+    }
+    // Both files go through the fs cache, so the SD library's one block
+    // buffer is not swapped between them for every record and print
+    FsCachedPrint out(outFile);
+    out.println(F("millis,value"));
+    SensorRecord record;
+    unsigned long stamp = 0;
+    bool sessionHigh = true;
+    unsigned long rows = 0;
+    unsigned long offset = 0;
+    while (fs_read_at(in, offset, &record, sizeof(record)) == sizeof(record)) {
+        offset += sizeof(record);
+        if (record.deltaMs == SENSOR_LOG_SESSION) {
+            if (sessionHigh) {
+                stamp = (unsigned long)record.value << 16;
+            } else {
+                stamp |= record.value;
+            }
+            sessionHigh = !sessionHigh;
+        } else if (record.deltaMs == SENSOR_LOG_GAP) {
+            stamp += record.value;
+        } else {
+            stamp += record.deltaMs;
+            out.print(stamp);
+            out.print(F(","));
+            out.println(record.value);
+            rows++;
+        }
+    }
+    fs_close(in);
+    fs_close(outFile);
+    Serial.print(F("Exported "));
+    Serial.print(rows);
+    Serial.println(F(" records to " SENSOR_LOG_CSV));
+    return true;
+}
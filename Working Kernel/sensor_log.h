@@ -0,0 +1,28 @@
+#ifndef SENSOR_LOG_H
+#define SENSOR_LOG_H
+
+#include <Arduino.h>
+
+// Binary sample log. Records are appended to a file that stays open and
+// collect in an fs cache line, so the card sees one write per line and the
+// directory entry is updated once per sector instead of every sample.
+
+#define SENSOR_LOG_FILE "distance.bin"
+#define SENSOR_LOG_CSV "distance.csv"
+#define SENSOR_LOG_SECTOR 512
+
+// Special deltaMs values
+#define SENSOR_LOG_GAP 0xFFFF      // value ms passed with no sample
+#define SENSOR_LOG_SESSION 0xFFFE  // two records carry the 32-bit millis() base, high half first
+
+struct SensorRecord {
+    uint16_t deltaMs;  // ms since the previous record
+    uint16_t value;
+};
+
+// at is the millis() the value was taken at, never earlier than the last one
+void sensor_log_record(unsigned long at, uint16_t value);
+void sensor_log_flush();
+bool sensor_log_export_csv();
+
+#endif
@@ -0,0 +1,142 @@
+#include "snapshot.h"
+#include "scheduler.h"
+#include "bluetooth_transfer.h"
+#include "hal.h"
+
+#define SNAPSHOT_TASKS_SIZE (sizeof(ScheduledTask) * TASK_COUNT)
+
+static bool autoRestore = true;
+static bool haveSnapshot = false;
+static byte newestSlot = 1;  // the first save goes to slot 0
+static uint16_t generation = 0;
+static bool dirty = false;
+static unsigned long lastSave = 0;
+
+static unsigned int slot_address(byte slot) {
+    return SNAPSHOT_BASE + slot * SNAPSHOT_SLOT_SIZE;
+}
+
+// Changes whenever tasks are added, removed, reordered or resized
+static uint16_t registry_layout() {
+    uint16_t crc = 0xFFFF;
+    for (byte i = 0; i < TASK_COUNT; i++) {
+        uint16_t hash = pgm_read_word(&taskRegistry[i].hash);
+        crc = bt_crc16(crc, (const uint8_t*)&hash, sizeof(hash));
+    }
+    uint8_t size = sizeof(ScheduledTask);
+    return bt_crc16(crc, &size, 1);
+}
+
+static uint16_t header_crc(const SnapshotHeader* header) {
+    uint16_t crc = bt_crc16(0xFFFF, &header->flags, 1);
+    crc = bt_crc16(crc, (const uint8_t*)&header->generation, sizeof(header->generation));
+    return bt_crc16(crc, (const uint8_t*)&header->layout, sizeof(header->layout));
+}
+
+// Reads a slot's header and checks it against the body, streamed in chunks
+static bool slot_valid(byte slot, SnapshotHeader* header) {
+    unsigned int address = slot_address(slot);
+    if (!readEEPROMBlock(address, (byte*)header, sizeof(SnapshotHeader))) return false;
+    if (header->magic != SNAPSHOT_MAGIC || header->version != SNAPSHOT_VERSION ||
+        header->layout != registry_layout()) {
+        return false;
+    }
+    uint16_t crc = header_crc(header);
+    byte chunk[16];
+    address += sizeof(SnapshotHeader);
+    for (unsigned int done = 0; done < SNAPSHOT_BODY_SIZE; done += sizeof(chunk)) {
+        unsigned int length = SNAPSHOT_BODY_SIZE - done;
+        if (length > sizeof(chunk)) length = sizeof(chunk);
+        if (!readEEPROMBlock(address + done, chunk, length)) return false;
+        crc = bt_crc16(crc, chunk, length);
+    }
+    return crc == header->crc;
+}
+
+bool snapshot_restore() {
+    SnapshotHeader headers[2];
+    bool valid[2];
+    for (byte slot = 0; slot < 2; slot++) {
+        valid[slot] = slot_valid(slot, &headers[slot]);
+    }
+    if (!valid[0] && !valid[1]) return false;
+    byte slot = 1;
+    if (!valid[1] || (valid[0] && (int16_t)(headers[0].generation - headers[1].generation) > 0)) {
+        slot = 0;
+    }
+    haveSnapshot = true;
+    newestSlot = slot;
+    generation = headers[slot].generation;
+    autoRestore = headers[slot].flags & SNAPSHOT_AUTO_RESTORE;
+
+    // The swap log carries on from its saved head even if no task comes back
+    unsigned int address = slot_address(slot) + sizeof(SnapshotHeader);
+    SwapStoreState store;
+    if (!readEEPROMBlock(address + SNAPSHOT_TASKS_SIZE, (byte*)&store, sizeof(store))) return false;
+    swap_store_restore(&store);
+    if (!autoRestore) return false;
+
+    if (!readEEPROMBlock(address, (byte*)taskList, SNAPSHOT_TASKS_SIZE)) {
+        memset(taskList, 0, sizeof(taskList));
+        return false;
+    }
+    return scheduler_readmit() > 0;
+}
+
+bool snapshot_save() {
+    SwapStoreState store;
+    swap_store_save(&store);
+
+    SnapshotHeader header;
+    header.magic = SNAPSHOT_MAGIC;
+    header.version = SNAPSHOT_VERSION;
+    header.flags = autoRestore ? SNAPSHOT_AUTO_RESTORE : 0;
+    header.generation = generation + 1;
+    header.layout = registry_layout();
+    uint16_t crc = header_crc(&header);
+    crc = bt_crc16(crc, (const uint8_t*)taskList, SNAPSHOT_TASKS_SIZE);
+    header.crc = bt_crc16(crc, (const uint8_t*)&store, sizeof(store));
+
+    // Body first, header last, into the slot not holding the newest snapshot
+    byte slot = haveSnapshot ? newestSlot ^ 1 : 0;
+    unsigned int address = slot_address(slot);
+    lastSave = hal_millis();
+    if (!writeEEPROMBlock(address + sizeof(header), (const byte*)taskList, SNAPSHOT_TASKS_SIZE) ||
+        !writeEEPROMBlock(address + sizeof(header) + SNAPSHOT_TASKS_SIZE, (const byte*)&store, sizeof(store)) ||
+        !writeEEPROMBlock(address, (const byte*)&header, sizeof(header))) {
+        return false;
+    }
+    haveSnapshot = true;
+    newestSlot = slot;
+    generation = header.generation;
+    dirty = false;
+    return true;
+}
+
+void snapshot_mark_dirty() {
+    dirty = true;
+}
+
+void snapshot_idle() {
+    if (dirty && hal_millis() - lastSave >= SNAPSHOT_INTERVAL_MS) {
+        snapshot_save();
+    }
+}
+
+void snapshot_set_auto_restore(bool enabled) {
+    autoRestore = enabled;
+}
+
+void snapshot_print() {
+    Serial.print(F("Auto-restore: "));
+    Serial.print(autoRestore ? F("on") : F("off"));
+    if (haveSnapshot) {
+        Serial.print(F(" | snapshot generation "));
+        Serial.print(generation);
+        Serial.print(F(" (slot "));
+        Serial.print(newestSlot);
+        Serial.println(')');
+    } else {
+        Serial.println(F(" | no snapshot"));
+    }
+}
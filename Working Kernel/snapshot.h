@@ -0,0 +1,52 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <Arduino.h>
+#include "eeprom.h"
+#include "swap_store.h"
+
+// Scheduler state saved to the top of the EEPROM so setup() can bring the
+// admitted tasks back after a reset. Two slots are written alternately,
+// body first and header last; a torn write leaves the older slot intact.
+//   header: magic | version | flags | generation | layout | crc16
+//   body:   taskList[TASK_COUNT] | SwapStoreState
+// layout is a hash of the registry, so a snapshot from a build with other
+// tasks is ignored. crc covers flags, generation, layout and the body.
+#define SNAPSHOT_MAGIC 0x5453  // "ST"
+#define SNAPSHOT_VERSION 2
+#define SNAPSHOT_SLOT_SIZE (EEPROM_SNAPSHOT_SIZE / 2)
+#define SNAPSHOT_BASE (EEPROM_SIZE - EEPROM_SNAPSHOT_SIZE)
+// Swapping alone changes the snapshot (log head, directory); it is then
+// saved at most this often. Each slot gets every other write, so at
+// 5 minutes a 1M-cycle part lasts about 19 years.
+#define SNAPSHOT_INTERVAL_MS 300000UL
+
+#define SNAPSHOT_AUTO_RESTORE 0x01
+
+struct SnapshotHeader {
+    uint16_t magic;
+    uint8_t version;
+    uint8_t flags;
+    uint16_t generation;
+    uint16_t layout;
+    uint16_t crc;
+};
+
+#define SNAPSHOT_BODY_SIZE (sizeof(ScheduledTask) * TASK_COUNT + sizeof(SwapStoreState))
+static_assert(sizeof(SnapshotHeader) + SNAPSHOT_BODY_SIZE <= SNAPSHOT_SLOT_SIZE,
+              "snapshot does not fit its EEPROM slot");
+static_assert(SNAPSHOT_SLOT_SIZE % EEPROM_PAGE_SIZE == 0, "snapshot slots must be page aligned");
+
+// Loads the newest valid snapshot. Admitted tasks are restored, released
+// now and started from the top, unless auto-restore was turned off.
+// Returns true if tasks were restored.
+bool snapshot_restore();
+// Writes the current state to the older slot
+bool snapshot_save();
+// Notes a change that only needs saving within SNAPSHOT_INTERVAL_MS
+void snapshot_mark_dirty();
+void snapshot_idle();
+void snapshot_set_auto_restore(bool enabled);
+void snapshot_print();
+
+#endif
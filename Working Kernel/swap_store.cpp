@@ -0,0 +1,237 @@
+#include "swap_store.h"
+#include "bluetooth_transfer.h"
+#include "hal.h"
+#include "klog.h"
+#include <string.h>
+
+// Newest record of each task, SWAP_SLOT_NONE if it has none
+static uint16_t swapIndex[TASK_COUNT];
+static uint16_t nextSeq;
+static uint8_t era;
+static bool eraKnown;  // false until a new log's first append picks it
+
+// The page at the head of the log and the records staged for it
+static byte pageBuffer[EEPROM_PAGE_SIZE];
+static uint16_t headPage;
+static byte headSlot;          // next slot of headPage to try
+static byte stagedMask;        // slots of headPage not yet written
+static unsigned long stagedSince;
+
+static unsigned int slot_address(uint16_t slot) {
+    return SWAP_STORE_BASE + (unsigned int)slot * SWAP_RECORD_SIZE;
+}
+
+static bool slot_live(uint16_t slot) {
+    for (byte t = 0; t < TASK_COUNT; t++) {
+        if (swapIndex[t] == slot) return true;
+    }
+    return false;
+}
+
+static uint16_t record_crc(const SwapRecordHeader* header, const byte* image) {
+    uint16_t crc = bt_crc16(0xFFFF, &header->task, 1);
+    crc = bt_crc16(crc, &header->era, 1);
+    crc = bt_crc16(crc, (const uint8_t*)&header->seq, sizeof(header->seq));
+    return bt_crc16(crc, image, sizeof(ScheduledTask));
+}
+
+void swap_store_init() {
+    for (byte t = 0; t < TASK_COUNT; t++) {
+        swapIndex[t] = SWAP_SLOT_NONE;
+    }
+    nextSeq = 0;
+    eraKnown = false;
+    headPage = 0;
+    headSlot = 0;
+    stagedMask = 0;
+}
+
+// Every log starts at slot 0, so the record there is from the newest
+// earlier log, if any. One past its era tells the new log from it and
+// from the 254 before it.
+static void era_begin() {
+    SwapRecordHeader header;
+    era = 0;
+    if (readEEPROMBlock(slot_address(0), (byte*)&header, sizeof(header)) && header.magic == SWAP_STORE_MAGIC) {
+        era = header.era + 1;
+    }
+    eraKnown = true;
+}
+
+bool swap_store_flush() {
+    if (stagedMask == 0) return true;
+    unsigned int pageAddress = slot_address(headPage * SWAP_SLOTS_PER_PAGE);
+    bool ok = true;
+    // One block per run of staged slots; live records in between stay untouched
+    byte slot = 0;
+    while (slot < SWAP_SLOTS_PER_PAGE) {
+        if (!(stagedMask & (1 << slot))) {
+            slot++;
+            continue;
+        }
+        byte runStart = slot;
+        while (slot < SWAP_SLOTS_PER_PAGE && (stagedMask & (1 << slot))) slot++;
+        unsigned int offset = runStart * SWAP_RECORD_SIZE;
+        unsigned int length = (slot - runStart) * SWAP_RECORD_SIZE;
+        if (writeEEPROMBlock(pageAddress + offset, pageBuffer + offset, length)) {
+            swapStats.bytesWritten += length;
+        } else {
+            ok = false;
+        }
+    }
+    if (!ok) {
+        // The images are not in EEPROM, so the index must not point at them
+        for (byte t = 0; t < TASK_COUNT; t++) {
+            uint16_t lost = swapIndex[t];
+            if (lost / SWAP_SLOTS_PER_PAGE == headPage && (stagedMask & (1 << (lost % SWAP_SLOTS_PER_PAGE)))) {
+                swapIndex[t] = SWAP_SLOT_NONE;
+                klog_task(KLOG_SWAP_WRITE_FAIL, t);
+            }
+        }
+    }
+    swapStats.flushes++;
+    stagedMask = 0;
+    return ok;
+}
+
+void swap_store_idle() {
+    if (stagedMask != 0 && hal_millis() - stagedSince >= SWAP_STORE_FLUSH_MS) {
+        swap_store_flush();
+    }
+}
+
+void swap_store_save(SwapStoreState* state) {
+    swap_store_flush();
+    memcpy(state->index, swapIndex, sizeof(swapIndex));
+    state->headPage = headPage;
+    state->nextSeq = nextSeq;
+    state->headSlot = headSlot;
+    if (!eraKnown) era_begin();
+    state->era = era;
+}
+
+// Reads the record in a slot; false if it is unreadable or fails its check
+static bool read_record(uint16_t slot, SwapRecordHeader* header, byte* image) {
+    byte buffer[sizeof(SwapRecordHeader) + sizeof(ScheduledTask)];
+    if (!readEEPROMBlock(slot_address(slot), buffer, sizeof(buffer))) return false;
+    memcpy(header, buffer, sizeof(*header));
+    memcpy(image, buffer + sizeof(*header), sizeof(ScheduledTask));
+    return header->magic == SWAP_STORE_MAGIC && header->task < TASK_COUNT && header->era == era &&
+           header->crc == record_crc(header, image);
+}
+
+// Records flushed after the snapshot was taken: the log is followed from
+// the snapshot's head, skipping live slots as swap_store_write() did,
+// while each slot holds this log's next sequence number. The first that
+// does not (an older lap or log, a torn or never written page) is where
+// the log ends.
+static void replay() {
+    byte image[sizeof(ScheduledTask)];
+    uint16_t page = headPage;
+    byte pageSlot = headSlot;
+    for (uint16_t scanned = 0; scanned < SWAP_STORE_SLOTS; scanned++) {
+        if (pageSlot == SWAP_SLOTS_PER_PAGE) {
+            page = (page + 1) % SWAP_STORE_PAGES;
+            pageSlot = 0;
+        }
+        uint16_t slot = page * SWAP_SLOTS_PER_PAGE + pageSlot++;
+        if (slot_live(slot)) continue;
+        SwapRecordHeader header;
+        if (!read_record(slot, &header, image) || header.seq != nextSeq) return;
+        swapIndex[header.task] = slot;
+        nextSeq++;
+        // The head moves only past records taken, as the appends moved it
+        headPage = page;
+        headSlot = pageSlot;
+    }
+}
+
+void swap_store_restore(const SwapStoreState* state) {
+    swap_store_init();
+    if (state->headPage >= SWAP_STORE_PAGES || state->headSlot > SWAP_SLOTS_PER_PAGE) return;
+    for (byte t = 0; t < TASK_COUNT; t++) {
+        if (state->index[t] < SWAP_STORE_SLOTS) swapIndex[t] = state->index[t];
+    }
+    headPage = state->headPage;
+    headSlot = state->headSlot;
+    nextSeq = state->nextSeq;
+    era = state->era;
+    eraKnown = true;
+    replay();
+}
+
+bool swap_store_has(byte task) {
+    return swapIndex[task] != SWAP_SLOT_NONE;
+}
+
+void swap_store_write(byte task, const ScheduledTask* image) {
+    if (!eraKnown) era_begin();
+    // Next slot that holds no task's newest record, the task's own included,
+    // so a torn write never destroys the only good image
+    uint16_t slot;
+    for (;;) {
+        if (headSlot == SWAP_SLOTS_PER_PAGE) {
+            swap_store_flush();
+            headPage = (headPage + 1) % SWAP_STORE_PAGES;
+            headSlot = 0;
+        }
+        slot = headPage * SWAP_SLOTS_PER_PAGE + headSlot;
+        if (!slot_live(slot)) break;
+        headSlot++;
+    }
+
+    SwapRecordHeader header;
+    header.magic = SWAP_STORE_MAGIC;
+    header.task = task;
+    header.era = era;
+    header.seq = nextSeq++;
+    header.crc = record_crc(&header, (const byte*)image);
+    byte* record = pageBuffer + headSlot * SWAP_RECORD_SIZE;
+    memcpy(record, &header, sizeof(header));
+    memcpy(record + sizeof(header), image, sizeof(ScheduledTask));
+
+    if (stagedMask == 0) stagedSince = hal_millis();
+    stagedMask |= 1 << headSlot;
+    headSlot++;
+    swapIndex[task] = slot;
+}
+
+bool swap_store_read(byte task, ScheduledTask* image) {
+    uint16_t slot = swapIndex[task];
+    if (slot == SWAP_SLOT_NONE) return false;
+
+    byte buffer[sizeof(SwapRecordHeader) + sizeof(ScheduledTask)];
+    byte pageSlot = slot % SWAP_SLOTS_PER_PAGE;
+    if (slot / SWAP_SLOTS_PER_PAGE == headPage && (stagedMask & (1 << pageSlot))) {
+        // Still staged, not in EEPROM yet
+        memcpy(buffer, pageBuffer + pageSlot * SWAP_RECORD_SIZE, sizeof(buffer));
+    } else if (!readEEPROMBlock(slot_address(slot), buffer, sizeof(buffer))) {
+        return false;
+    }
+
+    SwapRecordHeader header;
+    memcpy(&header, buffer, sizeof(header));
+    const byte* data = buffer + sizeof(header);
+    if (header.magic != SWAP_STORE_MAGIC || header.task != task || header.crc != record_crc(&header, data)) {
+        return false;
+    }
+    memcpy(image, data, sizeof(ScheduledTask));
+    return true;
+}
+
+void swap_store_print() {
+    Serial.print(F("Swap log: page "));
+    Serial.print(headPage);
+    Serial.print('/');
+    Serial.print(SWAP_STORE_PAGES);
+    Serial.print(F(" | seq "));
+    Serial.print(nextSeq);
+    Serial.print(F(" | staged "));
+    byte staged = 0;
+    for (byte slot = 0; slot < SWAP_SLOTS_PER_PAGE; slot++) {
+        if (stagedMask & (1 << slot)) staged++;
+    }
+    Serial.print(staged);
+    Serial.print(F(" | flushes "));
+    Serial.println(swapStats.flushes);
+}
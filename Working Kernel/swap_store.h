@@ -0,0 +1,77 @@
+#ifndef SWAP_STORE_H
+#define SWAP_STORE_H
+
+#include <Arduino.h>
+#include "eeprom.h"
+#include "scheduler.h"
+
+// Swapped task images, kept as an append-only log across the EEPROM so
+// every cell takes its share of the writes. A record is a header plus one
+// ScheduledTask, padded to a power of two so records never straddle a page:
+//   magic | task | era | seq (LE) | crc16 (LE, over task, era, seq and image) | image
+// Appends are staged in a one-page buffer and written when the page is
+// full or swap_store_flush() is called. A RAM index holds each task's
+// newest record. When the log wraps, records still in the index are left
+// where they are and the head skips over them, so live images are never
+// overwritten and nothing has to be copied. Sequence numbers restart with
+// each new log, started when no snapshot carried the old one over; the
+// era tells its records from those of earlier logs left in the EEPROM.
+// Only the loop calls it; the staging page and the I2C bus are not locked
+// against a preempted task.
+#define SWAP_STORE_MAGIC 0xA5
+#define SWAP_STORE_BASE 0
+#define SWAP_STORE_PAGES ((EEPROM_SIZE - EEPROM_SNAPSHOT_SIZE) / EEPROM_PAGE_SIZE)
+#define SWAP_STORE_FLUSH_MS 1000  // longest a staged record waits while idle
+
+struct SwapRecordHeader {
+    uint8_t magic;
+    uint8_t task;
+    uint8_t era;
+    uint16_t seq;
+    uint16_t crc;
+};
+
+constexpr unsigned int swap_record_size(unsigned int needed, unsigned int size = 8) {
+    return size >= needed ? size : swap_record_size(needed, size * 2);
+}
+
+#define SWAP_RECORD_SIZE swap_record_size(sizeof(SwapRecordHeader) + sizeof(ScheduledTask))
+#define SWAP_SLOTS_PER_PAGE (EEPROM_PAGE_SIZE / SWAP_RECORD_SIZE)
+#define SWAP_STORE_SLOTS (SWAP_STORE_PAGES * SWAP_SLOTS_PER_PAGE)
+#define SWAP_SLOT_NONE 0xFFFF
+
+// Index and log position, saved in the scheduler snapshot
+struct SwapStoreState {
+    uint16_t index[TASK_COUNT];
+    uint16_t headPage;
+    uint16_t nextSeq;
+    uint8_t headSlot;
+    uint8_t era;
+};
+
+static_assert(SWAP_RECORD_SIZE <= EEPROM_PAGE_SIZE, "a swap record must fit in one EEPROM page");
+static_assert(SWAP_SLOTS_PER_PAGE <= 8, "the staged-slot mask is one byte");
+static_assert(SWAP_STORE_SLOTS > TASK_COUNT + SWAP_SLOTS_PER_PAGE, "swap log too small for the registry");
+
+// Forgets every record and starts a new log at the first page; its era
+// is picked at the first append
+void swap_store_init();
+// Appends a new image for the task. It is staged first; a failed flush
+// logs KLOG_SWAP_WRITE_FAIL and drops the record from the index.
+void swap_store_write(byte task, const ScheduledTask* image);
+bool swap_store_has(byte task);
+// Reads the task's newest image; false if it has none or it fails its check
+bool swap_store_read(byte task, ScheduledTask* image);
+// Writes the staged records now, false if any write failed
+bool swap_store_flush();
+// Called from idle: flushes records that have been staged too long
+void swap_store_idle();
+// Flushes, then copies out the index and head for a snapshot
+void swap_store_save(SwapStoreState* state);
+// Continues the log from a snapshot; entries out of range are dropped.
+// Records flushed after the snapshot are found by their sequence numbers,
+// so each task gets its newest image back, not the one the snapshot saw.
+void swap_store_restore(const SwapStoreState* state);
+void swap_store_print();
+
+#endif
@@ -0,0 +1,27 @@
+#include "task_registry.h"
+
+#define TASK_REGISTRY_ENTRY(name, function, coroutine, period, priority, events, stack) \
+    { command_hash(name), name, function, coroutine, period, priority, events, stack },
+
+const TaskDefinition taskRegistry[TASK_COUNT] PROGMEM = {
+    TASK_REGISTRY(TASK_REGISTRY_ENTRY)
+};
+
+int task_registry_find(const char* name) {
+    uint16_t hash = command_hash_token(name);
+    int low = 0;
+    int high = TASK_COUNT - 1;
+    while (low <= high) {
+        int mid = (low + high) / 2;
+        uint16_t midHash = pgm_read_word(&taskRegistry[mid].hash);
+        if (midHash < hash) {
+            low = mid + 1;
+        } else if (midHash > hash) {
+            high = mid - 1;
+        } else {
+            // Hashes are unique, so this is the only candidate
+            return strcmp_P(name, taskRegistry[mid].name) == 0 ? mid : -1;
+        }
+    }
+    return -1;
+}
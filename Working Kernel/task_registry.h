@@ -0,0 +1,64 @@
+#ifndef TASK_REGISTRY_H
+#define TASK_REGISTRY_H
+
+#include <Arduino.h>
+#include "coroutine.h"
+#include "commands.h"
+#include "events.h"
+#include "distance_task.h"
+#include "led_task.h"
+#include "logger_task.h"
+#include "bench.h"
+
+// Every task the kernel can run, fixed at compile time and kept in flash.
+// Each task module declares its entry as
+//   X(name, function, coroutine, default period ms, default priority, events, stack)
+// with NULL for whichever entry point it does not have; events is the mask
+// of EVENT_BIT()s that wake it from CO_WAIT_EVENT, and stack its own stack
+// in bytes on AVR when KERNEL_PREEMPTIVE is set, 0 to run on the loop's
+// (preempt.h). The list below
+// must be in ascending command_hash(name) order; a static_assert checks it
+// and a binary search on the hash finds a task by name. A task's index in
+// the table is also its slot in taskList and taskStats.
+#define TASK_REGISTRY(X) \
+    LOGGER_TASK(X)       \
+    BENCH_TASKS(X)       \
+    LED_TASK(X)          \
+    DISTANCE_TASK(X)
+
+#define TASK_NAME_SIZE 10  // including the terminator
+
+typedef void (*TaskFunction)();
+
+struct TaskDefinition {
+    uint16_t hash;
+    char name[TASK_NAME_SIZE];
+    TaskFunction function;        // plain task, or NULL
+    CoroutineFunction coroutine;  // coroutine task, or NULL
+    uint16_t period;              // default period (ms) for "exec" without -t
+    int priority;                 // default priority for "exec" without -p
+    uint8_t events;               // subscribed event ids, EVENT_BIT() mask
+    uint8_t stack;                // preemptive mode stack (AVR bytes), 0 for none
+};
+
+// Hashes alone, for the compile-time checks and TASK_COUNT; never stored
+#define TASK_REGISTRY_HASH(name, function, coroutine, period, priority, events, stack) command_hash(name),
+constexpr uint16_t taskRegistryHashes[] = { TASK_REGISTRY(TASK_REGISTRY_HASH) };
+
+#define TASK_COUNT ((int)(sizeof(taskRegistryHashes) / sizeof(taskRegistryHashes[0])))
+
+template <size_t N>
+constexpr bool task_registry_sorted(const uint16_t (&hashes)[N], size_t i = 1) {
+    return i >= N || (hashes[i - 1] < hashes[i] && task_registry_sorted(hashes, i + 1));
+}
+
+static_assert(task_registry_sorted(taskRegistryHashes),
+              "TASK_REGISTRY must be in ascending command_hash order, without duplicates");
+static_assert(TASK_COUNT < 256, "task indexes are stored in a byte");
+
+extern const TaskDefinition taskRegistry[TASK_COUNT] PROGMEM;
+
+// Index of the named task, -1 if there is none
+int task_registry_find(const char* name);
+
+#endif
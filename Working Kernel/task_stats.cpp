@@ -0,0 +1,118 @@
+#include "task_stats.h"
+
+TaskStats taskStats[TASK_COUNT];
+
+void task_stats_reset() {
+    for (byte i = 0; i < TASK_COUNT; i++) {
+        task_stats_clear(i);
+    }
+}
+
+void task_stats_clear(int index) {
+    memset(&taskStats[index], 0, sizeof(TaskStats));
+    taskStats[index].execMinUs = 0xFFFFFFFFUL;
+}
+
+void task_stats_run(int index, unsigned long execUs, long jitterMs, bool ended, bool overrun) {
+    TaskStats* s = &taskStats[index];
+    s->runs++;
+    s->jobExecUs += execUs;
+    if (ended) {
+        if (s->jobExecUs > s->wcetUs) s->wcetUs = s->jobExecUs;
+        s->jobExecUs = 0;
+    }
+    s->execTotalUs += execUs;
+    if (execUs < s->execMinUs) s->execMinUs = execUs;
+    if (execUs > s->execMaxUs) s->execMaxUs = execUs;
+    if (jitterMs >= 0) {
+        s->jobs++;
+        s->jitterTotalMs += jitterMs;
+        if (jitterMs > s->jitterMaxMs) s->jitterMaxMs = jitterMs > 0xFFFF ? 0xFFFF : jitterMs;
+    }
+    if (overrun) s->overruns++;
+}
+
+unsigned long task_stats_wcet(int index) {
+    const TaskStats* s = &taskStats[index];
+    return s->wcetUs > 0 ? s->wcetUs : s->execMaxUs;
+}
+
+void task_stats_swap(int index, bool in, unsigned long us) {
+    TaskStats* s = &taskStats[index];
+    if (in) {
+        s->swapIns++;
+    } else {
+        s->swapOuts++;
+    }
+    s->swapUs += us;
+    if (us > s->swapMaxUs) s->swapMaxUs = us;
+}
+
+void task_stats_print() {
+    Serial.println(F("\n--- Task Stats ---"));
+    for (int i = 0; i < TASK_COUNT; i++) {
+        const TaskStats* s = &taskStats[i];
+        Serial.print(scheduler_task_name(i));
+        Serial.print(F(" | runs: "));
+        Serial.print(s->runs);
+        if (s->runs > 0) {
+            Serial.print(F(" | exec us min/avg/max: "));
+            Serial.print(s->execMinUs);
+            Serial.print('/');
+            Serial.print(s->execTotalUs / s->runs);
+            Serial.print('/');
+            Serial.print(s->execMaxUs);
+            Serial.print(F(" | wcet us: "));
+            Serial.print(task_stats_wcet(i));
+        }
+        if (s->jobs > 0) {
+            Serial.print(F(" | jitter ms avg/max: "));
+            Serial.print(s->jitterTotalMs / s->jobs);
+            Serial.print('/');
+            Serial.print(s->jitterMaxMs);
+        }
+        Serial.print(F(" | overruns: "));
+        Serial.print(s->overruns);
+        Serial.print(F(" | swaps in/out: "));
+        Serial.print(s->swapIns);
+        Serial.print('/');
+        Serial.print(s->swapOuts);
+        Serial.print(F(" ("));
+        Serial.print(s->swapUs);
+        Serial.println(F(" us)"));
+    }
+    Serial.println(F("------------------"));
+}
+
+static void dump_le(unsigned long value, byte size) {
+    for (byte i = 0; i < size; i++) {
+        Serial.write((uint8_t)(value >> (8 * i)));
+    }
+}
+
+void task_stats_dump() {
+    Serial.write((const uint8_t*)TASK_STATS_MAGIC, 4);
+    Serial.write((uint8_t)TASK_STATS_VERSION);
+    Serial.write((uint8_t)TASK_COUNT);
+    Serial.write((uint8_t)TASK_STATS_RECORD_SIZE);
+    for (int i = 0; i < TASK_COUNT; i++) {
+        const TaskStats* s = &taskStats[i];
+        char name[TASK_NAME_SIZE];
+        memset(name, 0, sizeof(name));
+        strncpy_P(name, taskRegistry[i].name, sizeof(name) - 1);
+        Serial.write((const uint8_t*)name, sizeof(name));
+        // Field by field so the layout does not depend on the compiler
+        dump_le(s->runs, 4);
+        dump_le(s->execMinUs, 4);
+        dump_le(s->execMaxUs, 4);
+        dump_le(s->execTotalUs, 4);
+        dump_le(s->jobs, 4);
+        dump_le(s->jitterTotalMs, 4);
+        dump_le(s->jitterMaxMs, 2);
+        dump_le(s->overruns, 2);
+        dump_le(s->swapIns, 2);
+        dump_le(s->swapOuts, 2);
+        dump_le(s->swapUs, 4);
+    }
+    Serial.println();
+}
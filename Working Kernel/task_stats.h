@@ -0,0 +1,48 @@
+#ifndef TASK_STATS_H
+#define TASK_STATS_H
+
+#include <Arduino.h>
+#include "scheduler.h"
+
+// Per-task runtime statistics, updated by the dispatcher. A run is one
+// call into the task (one slice for a coroutine); a job is one release.
+struct TaskStats {
+    unsigned long runs;
+    unsigned long execMinUs;
+    unsigned long execMaxUs;
+    unsigned long execTotalUs;   // mean = execTotalUs / runs
+    unsigned long jobs;
+    unsigned long jitterTotalMs; // release to first dispatch, mean = / jobs
+    uint16_t jitterMaxMs;
+    uint16_t overruns;           // jobs that finished after their deadline
+    uint16_t swapIns;
+    uint16_t swapOuts;
+    unsigned long swapUs;        // time spent moving this task to/from EEPROM
+    // Not in the binary dump
+    unsigned long jobExecUs;     // execution so far in the current job
+    unsigned long wcetUs;        // longest completed job, for admission control
+    unsigned long swapMaxUs;     // longest single swap in or out
+};
+
+// Binary dump ("stats bin"): magic, version, task count, record size, then
+// per task the 10-byte name followed by TaskStats, little-endian, unpadded.
+// tools/stats_decode.cpp turns a capture of it into CSV.
+#define TASK_STATS_MAGIC "TSTA"
+#define TASK_STATS_VERSION 1
+#define TASK_STATS_RECORD_SIZE 46
+
+extern TaskStats taskStats[TASK_COUNT];
+
+void task_stats_reset();
+void task_stats_clear(int index);
+// jitterMs < 0 when the run continues a job that already started; ended
+// when the run finished the job (overrun if it did so past the deadline)
+void task_stats_run(int index, unsigned long execUs, long jitterMs, bool ended, bool overrun);
+// Worst-case execution time of one job: the longest completed job, or
+// the longest run while no job has completed yet. 0 if never run.
+unsigned long task_stats_wcet(int index);
+void task_stats_swap(int index, bool in, unsigned long us);
+void task_stats_print();
+void task_stats_dump();
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+// The slice of the Arduino core the kernel uses, for the host build: types,
+// flash-string helpers (flash is plain memory here), Print/Stream and the
+// Serial console. Hardware access goes through hal.h (hal_host.cpp).
+
+#include <math.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+
+typedef uint8_t byte;
+
+#define HIGH 1
+#define LOW 0
+#define LED_BUILTIN 13
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define pgm_read_byte(address) (*(const uint8_t*)(address))
+#define pgm_read_word(address) (*(const uint16_t*)(address))
+#define pgm_read_dword(address) (*(const uint32_t*)(address))
+#define pgm_read_ptr(address) (*(const void* const*)(address))
+#define strcmp_P strcmp
+#define strncmp_P strncmp
+#define strlen_P strlen
+#define strcpy_P strcpy
+#define strncpy_P strncpy
+#define memcpy_P memcpy
+
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper*>(s))
+
+#define DEC 10
+#define HEX 16
+
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t value) = 0;
+    virtual size_t write(const uint8_t* data, size_t length);
+    size_t write(const char* text) { return write((const uint8_t*)text, strlen(text)); }
+    size_t write(const char* data, size_t length) { return write((const uint8_t*)data, length); }
+    virtual int availableForWrite() { return 0; }
+    virtual void flush() {}
+
+    size_t print(const __FlashStringHelper* text);
+    size_t print(const char* text);
+    size_t print(char value);
+    size_t print(int value, int base = DEC);
+    size_t print(unsigned int value, int base = DEC);
+    size_t print(long value, int base = DEC);
+    size_t print(unsigned long value, int base = DEC);
+    size_t print(double value, int digits = 2);
+
+    size_t println();
+    template <typename T>
+    size_t println(T value) { return print(value) + println(); }
+    template <typename T>
+    size_t println(T value, int format) { return print(value, format) + println(); }
+
+private:
+    size_t print_number(unsigned long value, int base);
+};
+
+class Stream : public Print {
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+};
+
+// Console: output is collected for the tests (host.h), input comes from
+// the same queue as hal_console_read()
+class HostSerial : public Stream {
+public:
+    size_t write(uint8_t value);
+    void flush();
+    int availableForWrite();
+    int available();
+    int read();
+    int peek();
+
+    using Print::write;
+};
+
+extern HostSerial Serial;
+
+#endif
@@ -0,0 +1,50 @@
+#include <Arduino.h>
+#include <stdio.h>
+
+// Print as the Arduino core formats it: no padding, upper-case hex,
+// "\r\n" line ends
+
+size_t Print::write(const uint8_t* data, size_t length) {
+    size_t written = 0;
+    while (length--) {
+        if (!write(*data++)) break;
+        written++;
+    }
+    return written;
+}
+
+size_t Print::print_number(unsigned long value, int base) {
+    char digits[8 * sizeof(unsigned long) + 1];
+    char* p = digits + sizeof(digits);
+    *--p = '\0';
+    if (base < 2) base = 10;
+    do {
+        unsigned long digit = value % base;
+        *--p = digit < 10 ? '0' + digit : 'A' + digit - 10;
+        value /= base;
+    } while (value);
+    return write(p);
+}
+
+size_t Print::print(const __FlashStringHelper* text) { return write(reinterpret_cast<const char*>(text)); }
+size_t Print::print(const char* text) { return write(text); }
+size_t Print::print(char value) { return write((uint8_t)value); }
+size_t Print::print(int value, int base) { return print((long)value, base); }
+size_t Print::print(unsigned int value, int base) { return print((unsigned long)value, base); }
+
+size_t Print::print(long value, int base) {
+    if (base == 10 && value < 0) {
+        return write('-') + print_number(-(unsigned long)value, 10);
+    }
+    return print_number((unsigned long)value, base);
+}
+
+size_t Print::print(unsigned long value, int base) { return print_number(value, base); }
+
+size_t Print::print(double value, int digits) {
+    char text[40];
+    snprintf(text, sizeof(text), "%.*f", digits, value);
+    return write(text);
+}
+
+size_t Print::println() { return write("\r\n"); }
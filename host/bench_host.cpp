@@ -0,0 +1,74 @@
+// Runs the kernel's `bench` command (bench.cpp) on the simulated board and
+// prints the results as one CSV table on stdout:
+//
+//   metric,param,count,min_us,mean_us,max_us,stddev_us,per_s
+//
+// Times are virtual (host.h): clock reads, I2C bytes and EEPROM write
+// cycles, SD operations and UART bit times as the host port models them,
+// not the PC's own speed. per_s is 10^6 / mean_us, that is dispatches,
+// swaps or commands per second; for bt_frame it is bytes per second
+// through the Bluetooth link instead. The param of a command row is the
+// command line.
+
+#include "host.h"
+#include "bluetooth_transfer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+void setup();
+void loop();
+
+#define BENCH_LIMIT_MS 600000UL  // virtual time before giving up
+
+static void print_row(const std::string& fields, const std::string& lineText) {
+    // metric,param,count,min,mean,max,stddev
+    std::string cells[7];
+    size_t start = 0;
+    for (int i = 0; i < 7; i++) {
+        size_t comma = fields.find(',', start);
+        cells[i] = fields.substr(start, comma == std::string::npos ? std::string::npos : comma - start);
+        start = comma == std::string::npos ? fields.size() : comma + 1;
+    }
+    double mean = atof(cells[4].c_str());
+    double perSecond = mean > 0 ? 1e6 / mean : 0;
+    if (cells[0] == "bt_frame") perSecond *= BT_FRAME_PAYLOAD + 5;  // SOH, seq, len, payload, CRC
+    if (cells[0] == "command") cells[1] = lineText;
+    printf("%s,%s,%s,%s,%s,%s,%s,%.0f\n", cells[0].c_str(), cells[1].c_str(), cells[2].c_str(),
+           cells[3].c_str(), cells[4].c_str(), cells[5].c_str(), cells[6].c_str(), perSecond);
+}
+
+int main() {
+    host_reset();
+    setup();
+    host_console_input("stop");
+    host_console_input("bench");
+    std::string& out = host_console_output();
+    for (unsigned long ms = 0; out.find("BENCH,done") == std::string::npos; ms += 100) {
+        if (ms >= BENCH_LIMIT_MS || out.find("before running the benchmark") != std::string::npos) {
+            fprintf(stderr, "bench did not finish:\n%s", out.c_str());
+            return 1;
+        }
+        host_run(loop, 100);
+    }
+
+    printf("metric,param,count,min_us,mean_us,max_us,stddev_us,per_s\n");
+    std::string lineText;
+    size_t at = 0;
+    while (at < out.size()) {
+        size_t end = out.find('\n', at);
+        if (end == std::string::npos) end = out.size();
+        std::string line = out.substr(at, end - at);
+        at = end + 1;
+        if (!line.empty() && line[line.size() - 1] == '\r') line.erase(line.size() - 1);
+        if (line.compare(0, 11, "BENCH_LINE,") == 0) {
+            // BENCH_LINE,<index>,<line>, printed before that command's row
+            lineText = line.substr(line.find(',', 11) + 1);
+        } else if (line.compare(0, 6, "BENCH,") == 0 && line != "BENCH,done") {
+            print_row(line.substr(6), lineText);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,478 @@
+#include "hal.h"
+#include "host.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <deque>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+// HAL port for running the kernel on a PC: a virtual clock, GPIO, a 24LC256
+// on I2C, an in-memory SD card and a Bluetooth serial line to a test peer.
+// See host.h for the timing model.
+
+HostStats hostStats;
+HostSerial Serial;
+
+struct HostEvent {
+    void (*callback)(void* context);
+    void* context;
+};
+
+static unsigned long long now;
+static unsigned long long runEnd = ~0ULL;
+static bool irqOn = true;
+static std::multimap<unsigned long long, HostEvent> events;
+
+static std::deque<char> consoleIn;
+static std::string consoleOut;
+static bool consoleEcho;
+static unsigned long consoleBaud = 9600;
+static unsigned long long consoleTxEnd;  // when the last queued byte is out
+
+#define HOST_PINS 32
+static bool pinLevel[HOST_PINS];
+static unsigned long pinWrites[HOST_PINS];
+static void (*pinHandler[HOST_PINS])();
+static void (*pinObserver)(uint8_t pin, bool high);
+
+static uint8_t eeprom[HOST_EEPROM_SIZE];
+static unsigned int eepromPointer;
+static unsigned long long eepromBusyUntil;
+static bool eepromFailing;
+
+struct HostSlot {
+    bool open;
+    std::string name;
+};
+
+static std::map<std::string, std::vector<uint8_t> > sdFiles;
+static HostSlot slots[HAL_FILES];
+static bool sdPresent = true;
+static bool sdMounted;
+
+static unsigned long btBaud = 9600;
+static std::deque<std::pair<unsigned long long, uint8_t> > btPending;
+static std::deque<uint8_t> btRx;
+static unsigned long long btLastArrival;
+static void (*btPeer)(uint8_t value, void* context);
+static void* btPeerContext;
+
+// Clock
+
+void host_reset() {
+    now = 0;
+    irqOn = true;
+    events.clear();
+    hostStats = HostStats();
+    consoleIn.clear();
+    consoleOut.clear();
+    consoleBaud = 9600;
+    consoleTxEnd = 0;
+    for (int i = 0; i < HOST_PINS; i++) {
+        pinLevel[i] = false;
+        pinWrites[i] = 0;
+        pinHandler[i] = NULL;
+    }
+    pinObserver = NULL;
+    memset(eeprom, 0xFF, sizeof(eeprom));
+    eepromPointer = 0;
+    eepromBusyUntil = 0;
+    eepromFailing = false;
+    sdFiles.clear();
+    for (int i = 0; i < HAL_FILES; i++) slots[i] = HostSlot();
+    sdPresent = true;
+    sdMounted = false;
+    btBaud = 9600;
+    btPending.clear();
+    btRx.clear();
+    btLastArrival = 0;
+    btPeer = NULL;
+    btPeerContext = NULL;
+}
+
+unsigned long long host_now_us() { return now; }
+
+void host_advance_us(unsigned long us) {
+    unsigned long long target = now + us;
+    while (irqOn && !events.empty() && events.begin()->first <= target) {
+        std::multimap<unsigned long long, HostEvent>::iterator first = events.begin();
+        HostEvent event = first->second;
+        if (first->first > now) now = first->first;
+        events.erase(first);
+        irqOn = false;
+        event.callback(event.context);
+        irqOn = true;
+    }
+    if (target > now) now = target;
+}
+
+struct HostRunEnd {};
+
+void host_run(void (*loop)(), unsigned long ms) {
+    runEnd = now + ms * 1000ULL;
+    try {
+        while (now < runEnd) loop();
+    } catch (HostRunEnd&) {
+    }
+    runEnd = ~0ULL;
+}
+
+void host_at(unsigned long long at, void (*callback)(void* context), void* context) {
+    HostEvent event = { callback, context };
+    events.insert(std::make_pair(at, event));
+}
+
+unsigned long hal_millis() {
+    host_advance_us(HOST_READ_US);
+    return now / 1000;
+}
+
+unsigned long hal_micros() {
+    host_advance_us(HOST_READ_US);
+    return now;
+}
+
+void hal_delay_us(unsigned int us) { host_advance_us(us); }
+
+uint8_t hal_irq_save() {
+    uint8_t state = irqOn;
+    irqOn = false;
+    return state;
+}
+
+void hal_irq_restore(uint8_t state) {
+    irqOn = state;
+    if (irqOn) host_advance_us(0);
+}
+
+void hal_sleep_cpu(unsigned long ms) {
+    irqOn = true;
+    if (ms == 0) {
+        host_advance_us(0);
+        return;
+    }
+    unsigned long long wake = (now / HOST_TICK_US + 1) * HOST_TICK_US;
+    if (HOST_TICKLESS && ms >= HOST_TICKLESS_MIN_MS) {
+        wake = now + (ms < HOST_TICKLESS_MAX_US / 1000 ? ms * 1000ULL : HOST_TICKLESS_MAX_US);
+    }
+    if (!events.empty() && events.begin()->first < wake) {
+        wake = events.begin()->first > now ? events.begin()->first : now;
+    } else {
+        hostStats.wakeups++;
+    }
+    if (wake > runEnd) wake = runEnd > now ? runEnd : now;
+    hostStats.sleeps++;
+    hostStats.sleptUs += wake - now;
+    host_advance_us(wake - now);
+    if (now >= runEnd) throw HostRunEnd();
+}
+
+// Console
+
+void host_console_input(const char* line) {
+    while (*line) consoleIn.push_back(*line++);
+    consoleIn.push_back('\n');
+}
+
+std::string& host_console_output() { return consoleOut; }
+void host_console_echo(bool enabled) { consoleEcho = enabled; }
+
+void hal_console_begin(unsigned long baud) { consoleBaud = baud; }
+
+int hal_console_available() {
+    host_advance_us(HOST_POLL_US);
+    return consoleIn.size();
+}
+
+int hal_console_read() {
+    if (consoleIn.empty()) return -1;
+    char c = consoleIn.front();
+    consoleIn.pop_front();
+    return (uint8_t)c;
+}
+
+static unsigned long console_byte_us() { return 10000000UL / consoleBaud; }
+
+int hal_console_tx_room() {
+    unsigned long queued = consoleTxEnd > now ? (consoleTxEnd - now + console_byte_us() - 1) / console_byte_us() : 0;
+    return queued >= HOST_CONSOLE_TX - 1 ? 0 : HOST_CONSOLE_TX - 1 - queued;
+}
+
+size_t HostSerial::write(uint8_t value) {
+    // Full: wait for the line to take a byte
+    if (hal_console_tx_room() == 0) host_advance_us(consoleTxEnd - now - (HOST_CONSOLE_TX - 2) * console_byte_us());
+    consoleTxEnd = (consoleTxEnd > now ? consoleTxEnd : now) + console_byte_us();
+    consoleOut += (char)value;
+    if (consoleEcho) fputc(value, stdout);
+    return 1;
+}
+
+void HostSerial::flush() {
+    if (consoleTxEnd > now) host_advance_us(consoleTxEnd - now);
+}
+
+int HostSerial::availableForWrite() { return hal_console_tx_room(); }
+int HostSerial::available() { return hal_console_available(); }
+int HostSerial::read() { return hal_console_read(); }
+int HostSerial::peek() { return consoleIn.empty() ? -1 : (uint8_t)consoleIn.front(); }
+
+// GPIO
+
+void host_on_pin_write(void (*observer)(uint8_t pin, bool high)) { pinObserver = observer; }
+bool host_pin_level(uint8_t pin) { return pin < HOST_PINS && pinLevel[pin]; }
+unsigned long host_pin_writes(uint8_t pin) { return pin < HOST_PINS ? pinWrites[pin] : 0; }
+
+static void pin_edge(void* context) {
+    uint8_t pin = (uint8_t)(uintptr_t)context;
+    if (pinHandler[pin]) pinHandler[pin]();
+}
+
+void host_pin_drive(uint8_t pin, bool high) {
+    if (pin >= HOST_PINS || pinLevel[pin] == high) return;
+    pinLevel[pin] = high;
+    if (pinHandler[pin]) host_at(now, pin_edge, (void*)(uintptr_t)pin);
+}
+
+void hal_pin_output(uint8_t) {}
+void hal_pin_input(uint8_t, bool) {}
+
+void hal_pin_write(uint8_t pin, bool high) {
+    if (pin >= HOST_PINS) return;
+    pinLevel[pin] = high;
+    pinWrites[pin]++;
+    if (pinObserver) pinObserver(pin, high);
+}
+
+bool hal_pin_read(uint8_t pin) { return host_pin_level(pin); }
+
+void hal_pin_on_change(uint8_t pin, void (*handler)()) {
+    if (pin < HOST_PINS) pinHandler[pin] = handler;
+}
+
+// I2C with a 24LC256 at HOST_EEPROM_ADDRESS: it NACKs while a write cycle
+// runs, and a write wraps within its page
+
+uint8_t* host_eeprom() { return eeprom; }
+void host_eeprom_fail(bool failing) { eepromFailing = failing; }
+
+static bool eeprom_acks(uint8_t device) {
+    return device == HOST_EEPROM_ADDRESS && !eepromFailing && now >= eepromBusyUntil;
+}
+
+void hal_i2c_begin() {}
+
+bool hal_i2c_probe(uint8_t device) {
+    hostStats.i2cTransactions++;
+    host_advance_us(HOST_I2C_BYTE_US);
+    return eeprom_acks(device);
+}
+
+bool hal_i2c_write(uint8_t device, const uint8_t* head, uint8_t headLength,
+                   const uint8_t* data, uint8_t length, bool) {
+    hostStats.i2cTransactions++;
+    if (!eeprom_acks(device) || headLength + length > HAL_I2C_MAX_WRITE) {
+        host_advance_us(HOST_I2C_BYTE_US);
+        return false;
+    }
+    host_advance_us((1 + headLength + length) * HOST_I2C_BYTE_US);
+    if (headLength >= 2) eepromPointer = ((head[0] << 8) | head[1]) % HOST_EEPROM_SIZE;
+    if (length > 0) {
+        unsigned int page = eepromPointer - eepromPointer % HOST_EEPROM_PAGE;
+        for (uint8_t i = 0; i < length; i++) {
+            eeprom[eepromPointer] = data[i];
+            eepromPointer = page + (eepromPointer + 1) % HOST_EEPROM_PAGE;
+        }
+        eepromBusyUntil = now + HOST_EEPROM_WRITE_US;
+        hostStats.eepromWrites++;
+    }
+    return true;
+}
+
+bool hal_i2c_read(uint8_t device, uint8_t* data, uint8_t length) {
+    hostStats.i2cTransactions++;
+    if (!eeprom_acks(device) || length > HAL_I2C_MAX_READ) {
+        host_advance_us(HOST_I2C_BYTE_US);
+        return false;
+    }
+    host_advance_us((1 + length) * HOST_I2C_BYTE_US);
+    for (uint8_t i = 0; i < length; i++) {
+        data[i] = eeprom[eepromPointer];
+        eepromPointer = (eepromPointer + 1) % HOST_EEPROM_SIZE;
+    }
+    return true;
+}
+
+// SD card
+
+static std::string sd_name(const char* name) {
+    std::string upper;
+    if (*name == '/') name++;
+    while (*name) upper += (char)toupper((unsigned char)*name++);
+    return upper;
+}
+
+static bool sd_ready() {
+    hostStats.sdOps++;
+    host_advance_us(HOST_SD_OP_US);
+    return sdPresent && sdMounted;
+}
+
+void host_sd_present(bool present) {
+    sdPresent = present;
+    if (!present) sdMounted = false;
+}
+
+void host_sd_put(const char* name, const void* data, size_t length) {
+    const uint8_t* bytes = (const uint8_t*)data;
+    sdFiles[sd_name(name)].assign(bytes, bytes + length);
+}
+
+bool host_sd_get(const char* name, std::string* data) {
+    std::map<std::string, std::vector<uint8_t> >::iterator file = sdFiles.find(sd_name(name));
+    if (file == sdFiles.end()) return false;
+    data->assign(file->second.begin(), file->second.end());
+    return true;
+}
+
+bool hal_sd_begin(uint8_t) {
+    hostStats.sdOps++;
+    host_advance_us(HOST_SD_OP_US);
+    sdMounted = sdPresent;
+    return sdMounted;
+}
+
+void hal_sd_end() { sdMounted = false; }
+
+bool hal_sd_exists(const char* name) { return sd_ready() && sdFiles.count(sd_name(name)); }
+
+long hal_sd_size(const char* name) {
+    if (!sd_ready()) return -1;
+    std::map<std::string, std::vector<uint8_t> >::iterator file = sdFiles.find(sd_name(name));
+    return file == sdFiles.end() ? -1 : (long)file->second.size();
+}
+
+bool hal_sd_remove(const char* name) { return sd_ready() && sdFiles.erase(sd_name(name)) > 0; }
+
+bool hal_sd_list(void (*entry)(const char* name, unsigned long size, bool directory, void* context),
+                 void* context) {
+    if (!sd_ready()) return false;
+    std::map<std::string, std::vector<uint8_t> > files = sdFiles;
+    for (std::map<std::string, std::vector<uint8_t> >::iterator file = files.begin(); file != files.end();
+         ++file) {
+        entry(file->first.c_str(), file->second.size(), false, context);
+    }
+    return true;
+}
+
+bool hal_file_open(uint8_t slot, const char* name, uint8_t mode) {
+    if (slot >= HAL_FILES || slots[slot].open || !sd_ready()) return false;
+    std::string upper = sd_name(name);
+    if (mode == HAL_FILE_APPEND) {
+        sdFiles[upper];
+    } else if (!sdFiles.count(upper)) {
+        return false;
+    }
+    slots[slot].open = true;
+    slots[slot].name = upper;
+    return true;
+}
+
+bool hal_file_is_open(uint8_t slot) { return slot < HAL_FILES && slots[slot].open; }
+
+void hal_file_close(uint8_t slot) {
+    if (slot < HAL_FILES) slots[slot] = HostSlot();
+}
+
+const char* hal_file_name(uint8_t slot) { return hal_file_is_open(slot) ? slots[slot].name.c_str() : ""; }
+
+unsigned long hal_file_size(uint8_t slot) {
+    if (!hal_file_is_open(slot)) return 0;
+    return sdFiles[slots[slot].name].size();
+}
+
+int hal_file_read_at(uint8_t slot, unsigned long offset, void* data, unsigned int length) {
+    if (!hal_file_is_open(slot) || !sd_ready()) return -1;
+    std::vector<uint8_t>& file = sdFiles[slots[slot].name];
+    if (offset >= file.size()) return 0;
+    if (length > file.size() - offset) length = file.size() - offset;
+    memcpy(data, &file[offset], length);
+    host_advance_us(length * HOST_SD_BYTE_US);
+    return length;
+}
+
+size_t hal_file_write(uint8_t slot, const void* data, size_t length) {
+    if (!hal_file_is_open(slot) || !sd_ready()) return 0;
+    const uint8_t* bytes = (const uint8_t*)data;
+    std::vector<uint8_t>& file = sdFiles[slots[slot].name];
+    file.insert(file.end(), bytes, bytes + length);
+    host_advance_us(length * HOST_SD_BYTE_US);
+    return length;
+}
+
+void hal_file_sync(uint8_t) {
+    hostStats.sdOps++;
+    host_advance_us(HOST_SD_OP_US);
+}
+
+// Bluetooth serial
+
+static unsigned long bt_byte_us() { return 10000000UL / btBaud; }
+
+static void bt_deliver() {
+    while (!btPending.empty() && btPending.front().first <= now) {
+        if (btRx.size() < HOST_UART_RX) {
+            btRx.push_back(btPending.front().second);
+        } else {
+            hostStats.btRxDropped++;
+        }
+        btPending.pop_front();
+    }
+}
+
+void host_bt_peer(void (*peer)(uint8_t value, void* context), void* context) {
+    btPeer = peer;
+    btPeerContext = context;
+}
+
+void host_bt_inject(const void* data, size_t length) {
+    const uint8_t* bytes = (const uint8_t*)data;
+    if (btLastArrival < now) btLastArrival = now;
+    while (length--) {
+        btLastArrival += bt_byte_us();
+        btPending.push_back(std::make_pair(btLastArrival, *bytes++));
+    }
+}
+
+unsigned long host_bt_baud() { return btBaud; }
+
+void hal_bt_begin(unsigned long baud) { btBaud = baud; }
+
+int hal_bt_available() {
+    host_advance_us(HOST_POLL_US);
+    bt_deliver();
+    return btRx.size();
+}
+
+int hal_bt_read() {
+    bt_deliver();
+    if (btRx.empty()) return -1;
+    uint8_t value = btRx.front();
+    btRx.pop_front();
+    return value;
+}
+
+int hal_bt_peek() {
+    bt_deliver();
+    return btRx.empty() ? -1 : btRx.front();
+}
+
+size_t hal_bt_write(uint8_t value) {
+    host_advance_us(bt_byte_us());
+    hostStats.btTxBytes++;
+    if (btPeer) btPeer(value, btPeerContext);
+    return 1;
+}
+
+int hal_bt_tx_room() { return 63; }
@@ -0,0 +1,86 @@
+#ifndef HOST_H
+#define HOST_H
+
+// Test hooks for the host port (hal_host.cpp). Time is virtual: it only
+// moves when the kernel reads it, waits, sleeps or talks to a device, so a
+// run is the same every time. Callbacks scheduled with host_at() stand in
+// for interrupts; they run once interrupts are on and the clock reaches
+// them, with interrupts off, like an ISR.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+#define HOST_READ_US 4         // cost of reading the clock
+#define HOST_POLL_US 2         // cost of polling a serial port
+#define HOST_TICK_US 1024      // Timer0 overflow, wakes the CPU from sleep
+// Like the AVR backend, sleeps of HOST_TICKLESS_MIN_MS or more skip the
+// tick and last up to HOST_TICKLESS_MAX_US; 0 wakes on every tick
+#ifndef HOST_TICKLESS
+#define HOST_TICKLESS 1
+#endif
+#define HOST_TICKLESS_MIN_MS 2
+#define HOST_TICKLESS_MAX_US 260000
+#define HOST_I2C_BYTE_US 90    // 9 bits at 100 kHz
+#define HOST_EEPROM_ADDRESS 0x50
+#define HOST_EEPROM_SIZE 32768
+#define HOST_EEPROM_PAGE 64
+#define HOST_EEPROM_WRITE_US 5000  // tWC
+#define HOST_UART_RX 64        // bytes the Bluetooth UART holds before dropping
+#define HOST_CONSOLE_TX 64     // console transmit buffer; a write into a full one waits
+#define HOST_SD_OP_US 200      // command and busy time of one SD operation
+#define HOST_SD_BYTE_US 1      // SPI at 8 MHz
+
+struct HostStats {
+    unsigned long sleeps;         // hal_sleep_cpu() calls
+    unsigned long wakeups;        // of those, ended by a timer, not an interrupt
+    unsigned long long sleptUs;
+    unsigned long eepromWrites;   // page write cycles
+    unsigned long i2cTransactions;
+    unsigned long sdOps;
+    unsigned long btTxBytes;
+    unsigned long btRxDropped;    // arrived while the UART buffer was full
+};
+
+extern HostStats hostStats;
+
+// Clears the clock, devices, files and hooks
+void host_reset();
+unsigned long long host_now_us();
+// Calls loop() until ms have passed. Idle sleeps until there is work, so
+// a sleep that would run past the end unwinds loop() and returns there.
+void host_run(void (*loop)(), unsigned long ms);
+// Moves the clock forward, running due callbacks if interrupts are on
+void host_advance_us(unsigned long us);
+void host_at(unsigned long long at, void (*callback)(void* context), void* context);
+
+// Console. Output leaves at 10 bit times per byte of the hal_console_begin()
+// baud rate through a HOST_CONSOLE_TX-byte buffer, like the AVR core's Serial.
+void host_console_input(const char* line);  // queued with a trailing '\n'
+std::string& host_console_output();
+void host_console_echo(bool enabled);  // also copy output to stdout
+
+// GPIO. The observer sees every hal_pin_write(); host_pin_drive() sets an
+// input and raises its on-change handler.
+void host_on_pin_write(void (*observer)(uint8_t pin, bool high));
+bool host_pin_level(uint8_t pin);
+void host_pin_drive(uint8_t pin, bool high);
+unsigned long host_pin_writes(uint8_t pin);
+
+// 24LC256
+uint8_t* host_eeprom();
+void host_eeprom_fail(bool failing);  // NACK everything, like a missing chip
+
+// SD card; names are stored upper case, as FAT 8.3 reports them. Every
+// operation takes HOST_SD_OP_US, plus HOST_SD_BYTE_US per byte moved.
+void host_sd_present(bool present);
+void host_sd_put(const char* name, const void* data, size_t length);
+bool host_sd_get(const char* name, std::string* data);
+
+// Bluetooth serial. Bytes the kernel writes take 10 bit times each and go
+// to the peer; replies the peer injects arrive after the same line delay.
+void host_bt_peer(void (*peer)(uint8_t value, void* context), void* context);
+void host_bt_inject(const void* data, size_t length);
+unsigned long host_bt_baud();
+
+#endif
@@ -0,0 +1,67 @@
+#define BT_CLIENT_NO_MAIN
+#include "../tools/bt_client.cpp"
+#include "bt_peer.h"
+#include "host.h"
+
+static BtReceiver* receiver;
+
+// Frame being collected off the line: SOH, seq, len, payload, crc16
+static uint8_t frame[5 + BT_FRAME_PAYLOAD];
+static size_t frameLength;
+static unsigned long frames;
+static unsigned long replies;
+static unsigned int dropEvery;
+static unsigned int duplicateEvery;
+static unsigned int duplicateReplyEvery;
+
+static bool every(unsigned long count, unsigned int period) {
+    return period != 0 && count % period == 0;
+}
+
+static void peer_reply(uint8_t type, uint8_t seq, void*) {
+    uint8_t reply[2] = { type, seq };
+    host_bt_inject(reply, sizeof(reply));
+    if (every(++replies, duplicateReplyEvery)) host_bt_inject(reply, sizeof(reply));
+}
+
+static void deliver(const uint8_t* data, size_t length) {
+    for (size_t i = 0; i < length; i++) receiver->feed(data[i]);
+}
+
+static void peer_feed(uint8_t value, void*) {
+    if (frameLength == 0 && value != BT_SOH) {
+        receiver->feed(value);
+        return;
+    }
+    frame[frameLength++] = value;
+    if (frameLength < 3 || frameLength < 5u + frame[2]) return;
+    frames++;
+    if (!every(frames, dropEvery)) {
+        deliver(frame, frameLength);
+        if (every(frames, duplicateEvery)) deliver(frame, frameLength);
+    }
+    frameLength = 0;
+}
+
+void bt_peer_start() {
+    delete receiver;
+    receiver = new BtReceiver();
+    receiver->reply = peer_reply;
+    frameLength = 0;
+    frames = 0;
+    replies = 0;
+    bt_peer_faults(0, 0, 0);
+    host_bt_peer(peer_feed, NULL);
+}
+
+void bt_peer_faults(unsigned int drop, unsigned int duplicate, unsigned int duplicateReply) {
+    dropEvery = drop;
+    duplicateEvery = duplicate;
+    duplicateReplyEvery = duplicateReply;
+}
+
+bool bt_peer_done() { return receiver->done; }
+const std::string& bt_peer_name() { return receiver->name; }
+const std::string& bt_peer_data() { return receiver->data; }
+unsigned long bt_peer_bad_frames() { return receiver->badFrames; }
+unsigned long bt_peer_frames() { return frames; }
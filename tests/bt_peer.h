@@ -0,0 +1,19 @@
+#ifndef BT_PEER_H
+#define BT_PEER_H
+
+#include <string>
+
+// The BTSEND receiver from tools/bt_client.cpp on the far end of the host
+// Bluetooth line; its ACK/NAK replies go back over the same line
+void bt_peer_start();
+// Makes the line lossy, deterministically: every dropEvery-th frame is
+// lost, every duplicateEvery-th frame arrives twice and every
+// duplicateReplyEvery-th reply is sent twice. 0 turns a fault off.
+void bt_peer_faults(unsigned int dropEvery, unsigned int duplicateEvery, unsigned int duplicateReplyEvery);
+bool bt_peer_done();
+const std::string& bt_peer_name();
+const std::string& bt_peer_data();
+unsigned long bt_peer_bad_frames();
+unsigned long bt_peer_frames();  // frames the sender put on the line
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+// Minimal assertions for the host tests: a failed CHECK prints where and
+// carries on, check_result() turns the tally into the exit status.
+
+#include <stdio.h>
+
+static int checkFailures = 0;
+
+#define CHECK(condition)                                                        \
+    do {                                                                        \
+        if (!(condition)) {                                                     \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            checkFailures++;                                                    \
+        }                                                                       \
+    } while (0)
+
+#define CHECK_EQ(actual, expected)                                              \
+    do {                                                                        \
+        long long checkActual = (long long)(actual);                            \
+        long long checkExpected = (long long)(expected);                        \
+        if (checkActual != checkExpected) {                                     \
+            fprintf(stderr, "%s:%d: %s is %lld, expected %lld\n", __FILE__, __LINE__, #actual, \
+                    checkActual, checkExpected);                                \
+            checkFailures++;                                                    \
+        }                                                                       \
+    } while (0)
+
+static inline int check_result() {
+    if (checkFailures) fprintf(stderr, "%d check(s) failed\n", checkFailures);
+    return checkFailures ? 1 : 0;
+}
+
+#endif
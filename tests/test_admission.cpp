@@ -0,0 +1,136 @@
+#include "check.h"
+#include "host.h"
+#include "kernel_config.h"
+#include "admission.h"
+#include "scheduler.h"
+#include "task_registry.h"
+#include "task_stats.h"
+
+// Admission decisions on hand-made task sets. Linked against the bench
+// build, whose scratch tasks make more tasks than MAX_TASKS admissible.
+// Built once per SCHED_POLICY.
+
+static int logger, led, distance, bench0;
+
+static void clear_set() {
+    for (int i = 0; i < TASK_COUNT; i++) {
+        memset(&taskList[i], 0, sizeof(ScheduledTask));
+        task_stats_clear(i);
+    }
+    host_console_output().clear();
+}
+
+// An admitted task whose jobs have taken wcetUs at most
+static void admitted(int index, unsigned long periodMs, int priority, unsigned long wcetUs) {
+    taskList[index].period = periodMs / TASK_TICK_MS;
+    taskList[index].priority = priority;
+    taskList[index].active = 1;
+    taskStats[index].wcetUs = wcetUs;
+    taskStats[index].execMaxUs = wcetUs;
+}
+
+static bool admit(int index, unsigned long periodMs, int priority, unsigned long wcetUs, bool force) {
+    taskStats[index].wcetUs = wcetUs;
+    taskStats[index].execMaxUs = wcetUs;
+    return admission_admit(index, periodMs / TASK_TICK_MS, priority, force);
+}
+
+static bool printed(const char* text) {
+    return host_console_output().find(text) != std::string::npos;
+}
+
+static void test_accept() {
+    clear_set();
+    admitted(led, 100, 2, 20000);
+    CHECK(admit(distance, 200, 1, 30000, false));
+    CHECK(!printed("Admission check failed"));
+}
+
+#if SCHED_POLICY == SCHED_EDF
+// Over 100% utilisation cannot be scheduled at all
+static void test_reject() {
+    clear_set();
+    admitted(led, 100, 2, 60000);
+    CHECK(!admit(distance, 100, 1, 50000, false));
+    CHECK(printed("misses its deadline"));
+    CHECK(printed("Not admitted"));
+}
+#else
+// 60 ms of led every 100 ms leaves distance's 50 ms job no room
+static void test_reject() {
+    clear_set();
+    admitted(led, 100, 2, 60000);
+    CHECK(!admit(distance, 100, 1, 50000, false));
+    CHECK(printed("distance | T 100 ms"));
+    CHECK(printed("Not admitted"));
+
+    // A shorter job misses at 90 ms and fits at 200 ms
+    host_console_output().clear();
+    CHECK(!admit(distance, 90, 1, 40000, false));
+    host_console_output().clear();
+    CHECK(admit(distance, 200, 1, 40000, false));
+}
+#endif
+
+static void test_force() {
+    clear_set();
+    admitted(led, 100, 2, 60000);
+    CHECK(admit(distance, 100, 1, 50000, true));
+    CHECK(printed("Admitted anyway (-f)."));
+
+#if SCHED_POLICY != SCHED_EDF
+    // Once forced in, the missing task does not block a task it cannot delay
+    admitted(distance, 100, 1, 50000);
+    host_console_output().clear();
+    CHECK(admit(bench0, 5000, TASK_MAX_PRIORITY, 1000, false));
+#endif
+}
+
+// Period 0 runs in the background and is not analysed; whatever its
+// priority, it only delays periodic tasks by the run it is in
+static void test_background() {
+    clear_set();
+    admitted(led, 100, 2, 40000);
+    CHECK(admit(distance, 0, TASK_MAX_PRIORITY, 50000, false));
+#if !KERNEL_PREEMPTIVE
+    host_console_output().clear();
+    CHECK(!admit(distance, 0, TASK_MAX_PRIORITY, 70000, false));
+    CHECK(printed("led | T 100 ms"));
+#endif
+}
+
+// Past MAX_TASKS every job may need a swap in and out first: twice the
+// longest measured swap (5 ms each before one is measured) is added to
+// every task's cost
+static void test_swap_cost() {
+    static_assert(MAX_TASKS == 3, "the set below admits MAX_TASKS + 1 tasks");
+    clear_set();
+    admitted(led, 100, 3, 46000);
+    admitted(distance, 100, 2, 35000);
+    admitted(logger, 1000, 1, 1000);
+    // Three admitted: they fit in RAM, no swap is charged
+    CHECK(admit(logger, 1000, 1, 1000, false));
+
+    // A fourth is charged 10 ms a job and pushes the set over
+    CHECK(!admit(bench0, 1000, 0, 1000, false));
+
+    // Measured swaps are cheaper than the default: 2 ms a job fits
+    taskStats[logger].swapMaxUs = 1000;
+    host_console_output().clear();
+    CHECK(admit(bench0, 1000, 0, 1000, false));
+}
+
+int main() {
+    host_reset();
+    logger = task_registry_find("logger");
+    led = task_registry_find("led");
+    distance = task_registry_find("distance");
+    bench0 = task_registry_find("bench0");
+    CHECK(logger >= 0 && led >= 0 && distance >= 0 && bench0 >= 0);
+    test_accept();
+    test_reject();
+    test_force();
+    test_background();
+    test_swap_cost();
+    return check_result();
+}
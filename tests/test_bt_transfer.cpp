@@ -0,0 +1,98 @@
+#include "check.h"
+#include "host.h"
+#include "bt_peer.h"
+#include "bluetooth_transfer.h"
+
+void setup();
+void loop();
+
+static void command(const char* line) {
+    host_console_input(line);
+    host_run(loop, 10);
+}
+
+static std::string pattern(size_t length) {
+    std::string data;
+    for (size_t i = 0; i < length; i++) data += (char)(i * 7 + i / 13);
+    return data;
+}
+
+static void test_crc() {
+    // CRC-16/CCITT-FALSE check value
+    CHECK_EQ(bt_crc16(0xFFFF, (const uint8_t*)"123456789", 9), 0x29B1);
+    CHECK_EQ(bt_crc16(0xFFFF, NULL, 0), 0xFFFF);
+}
+
+// Header frame, 79 data frames, end frame
+#define BIG_FRAMES (2 + (5000 + BT_FRAME_PAYLOAD - 1) / BT_FRAME_PAYLOAD)
+
+static bool send_big(unsigned int dropEvery, unsigned int duplicateEvery, unsigned int duplicateReplyEvery) {
+    bt_peer_start();
+    bt_peer_faults(dropEvery, duplicateEvery, duplicateReplyEvery);
+    host_console_output().clear();
+    command("BTSEND BIG.BIN");
+    bool sent = host_console_output().find("File sent successfully") != std::string::npos;
+    return sent && bt_peer_done() && bt_peer_name() == "BIG.BIN" && bt_peer_data() == pattern(5000);
+}
+
+static void test_send() {
+    CHECK(send_big(0, 0, 0));
+    CHECK_EQ(bt_peer_frames(), BIG_FRAMES);
+    CHECK_EQ(bt_peer_bad_frames(), 0);
+    CHECK(!btTransferActive);
+}
+
+static void test_stale_replies() {
+    // Every reply twice: the copies are outside the window by then and
+    // must not send anything again
+    CHECK(send_big(0, 0, 1));
+    CHECK_EQ(bt_peer_frames(), BIG_FRAMES);
+
+    // Duplicated frames make the receiver re-ACK what it already has
+    CHECK(send_big(0, 3, 0));
+    CHECK_EQ(bt_peer_frames(), BIG_FRAMES);
+}
+
+static void test_lossy() {
+    // A lost frame costs at most a window's worth of frames sent again
+    CHECK(send_big(13, 5, 4));
+    CHECK(bt_peer_frames() > BIG_FRAMES);
+    CHECK(bt_peer_frames() <= BIG_FRAMES * 13 / (13 - BT_WINDOW) + 13);
+}
+
+static std::string upload;
+
+static void start_upload(void*) { host_bt_inject(upload.data(), upload.size()); }
+
+static void test_receive() {
+    std::string body;
+    for (int line = 0; line < 40; line++) body += "line " + std::to_string(line) + " of the upload\n";
+    upload = "START:RX.TXT\n" + body + "END_TRANSFER";
+    host_bt_peer(NULL, NULL);
+    host_console_output().clear();
+    // BTGET blocks until the transfer ends, so the sender is scheduled to
+    // start once the prompt is out, as someone reading it would
+    host_at(host_now_us() + 200000, start_upload, NULL);
+    command("BTGET");
+    CHECK(host_console_output().find("File received and saved successfully") != std::string::npos);
+
+    std::string stored;
+    CHECK(host_sd_get("RX.TXT", &stored));
+    CHECK(stored == body);
+    CHECK_EQ(hostStats.btRxDropped, 0);
+}
+
+int main() {
+    host_reset();
+    // The file index is built when the card mounts, so files go on first
+    std::string data = pattern(5000);
+    host_sd_put("BIG.BIN", data.data(), data.size());
+    setup();
+    command("stop");
+    test_crc();
+    test_send();
+    test_stale_replies();
+    test_lossy();
+    test_receive();
+    return check_result();
+}
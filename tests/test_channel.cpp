@@ -0,0 +1,140 @@
+#include "check.h"
+#include "host.h"
+#include "channel.h"
+
+#define TEST_EVENT (EVENT_COUNT - 1)  // no task subscribes to it
+
+static void test_channel_full_empty() {
+    Channel<int, 4> ch(TEST_EVENT);
+    CHECK(ch.empty());
+    CHECK(ch.peek() == NULL);
+    for (int i = 0; i < 3; i++) {
+        int* slot = ch.reserve();
+        CHECK(slot != NULL);
+        if (slot == NULL) return;
+        *slot = i;
+        ch.commit();
+    }
+    // Capacity - 1 items: one slot stays free to tell full from empty
+    CHECK_EQ(ch.count(), 3);
+    CHECK(ch.reserve() == NULL);
+    CHECK_EQ(ch.dropped(), 1);
+    CHECK(events_pending());
+    events_dispatch();
+
+    for (int i = 0; i < 3; i++) {
+        const int* item = ch.peek();
+        CHECK(item != NULL);
+        if (item == NULL) return;
+        CHECK_EQ(*item, i);
+        ch.release();
+    }
+    CHECK(ch.empty());
+    CHECK(ch.peek() == NULL);
+    CHECK(!events_pending());
+}
+
+// Indexes wrap at the capacity, not at 256: order and count hold across it
+static void test_channel_wrap() {
+    Channel<int, 5> ch(TEST_EVENT);
+    int next = 0;
+    int expected = 0;
+    for (int round = 0; round < 40; round++) {
+        // Two in, one or two out: the indexes wrap often and it runs full
+        for (int i = 0; i < 2; i++) {
+            int* slot = ch.reserve();
+            if (slot == NULL) continue;
+            *slot = next++;
+            ch.commit();
+        }
+        for (int i = 0; i < 1 + round % 2; i++) {
+            const int* item = ch.peek();
+            if (item == NULL) break;
+            CHECK_EQ(*item, expected);
+            expected++;
+            ch.release();
+        }
+        CHECK_EQ(ch.count(), next - expected);
+        CHECK(ch.count() <= 4);
+    }
+    // It filled up on the way: every reserve either got a slot or counted a drop
+    CHECK(ch.dropped() > 0);
+    CHECK_EQ(next + ch.dropped(), 80);
+    events_dispatch();
+}
+
+static void test_mailbox() {
+    Mailbox<int> box(TEST_EVENT);
+    CHECK(!box.updated());
+    CHECK(box.read() == NULL);
+
+    *box.reserve() = 1;
+    box.commit();
+    CHECK(box.updated());
+    CHECK(events_pending());
+    events_dispatch();
+    const int* item = box.read();
+    CHECK(item != NULL && *item == 1);
+    CHECK(box.read() == NULL);
+
+    // Newer commits replace an untaken item, the reader gets the newest
+    *box.reserve() = 2;
+    box.commit();
+    *box.reserve() = 3;
+    box.commit();
+    CHECK_EQ(box.overwritten(), 1);
+    item = box.read();
+    CHECK(item != NULL && *item == 3);
+
+    // What the reader holds is not written under it, however often the
+    // writer commits, until it reads again
+    for (int i = 4; i < 10; i++) {
+        *box.reserve() = i;
+        box.commit();
+        CHECK(*item == 3);
+    }
+    item = box.read();
+    CHECK(item != NULL && *item == 9);
+    events_dispatch();
+}
+
+static Mailbox<int> inbox(TEST_EVENT);
+static const int* received;
+
+static uint8_t receiver(Coroutine* co) {
+    CO_BEGIN(co);
+    CO_MAILBOX_READ(co, inbox, received, 50);
+    CO_END(co);
+}
+
+// The receive blocks on the event with a timeout, like any CO_WAIT_EVENT
+static void test_mailbox_receive() {
+    Coroutine co = { 0, 0 };
+    received = NULL;
+    CHECK_EQ(receiver(&co), CO_EVENT);
+    host_advance_us(10000);
+    CHECK_EQ(receiver(&co), CO_EVENT);
+    *inbox.reserve() = 42;
+    inbox.commit();
+    CHECK_EQ(receiver(&co), CO_ENDED);
+    CHECK(received != NULL && *received == 42);
+
+    // Nothing new: NULL once ms have passed
+    CHECK_EQ(receiver(&co), CO_EVENT);
+    host_advance_us(49000);
+    CHECK_EQ(receiver(&co), CO_EVENT);
+    host_advance_us(2000);
+    CHECK_EQ(receiver(&co), CO_ENDED);
+    CHECK(received == NULL);
+    events_dispatch();
+}
+
+int main() {
+    host_reset();
+    events_init();
+    test_channel_full_empty();
+    test_channel_wrap();
+    test_mailbox();
+    test_mailbox_receive();
+    return check_result();
+}
@@ -0,0 +1,53 @@
+#include "check.h"
+#include "host.h"
+#include "commands.h"
+#include "scheduler.h"
+#include "task_registry.h"
+
+void setup();
+
+static_assert(command_hash("exec") != command_hash("halt"), "command hashes collide");
+
+static bool run(const char* line, const char* reply) {
+    char buffer[CMD_BUFFER_SIZE];
+    strncpy(buffer, line, sizeof(buffer) - 1);
+    buffer[sizeof(buffer) - 1] = '\0';
+    host_console_output().clear();
+    command_execute(buffer);
+    if (host_console_output().find(reply) != std::string::npos) return true;
+    fprintf(stderr, "'%s' printed:\n%s\n", line, host_console_output().c_str());
+    return false;
+}
+
+static void test_hash() {
+    CHECK_EQ(command_hash_token("BTSEND"), command_hash("BTSEND"));
+    CHECK_EQ(command_hash_token(""), 5381);
+    CHECK(task_registry_find("led") >= 0);
+    CHECK(task_registry_find("distance") >= 0);
+    CHECK_EQ(task_registry_find("nosuch"), -1);
+}
+
+static void test_parse() {
+    CHECK(run("bogus", "Invalid command!"));
+    CHECK(run("a b c d e f g h i", "Too many arguments."));
+    CHECK(run("exec", "Usage: exec <task>"));
+    CHECK(run("exec led -x 1", "Unknown option: -x"));
+    CHECK(run("exec led -t", "Missing or invalid value for -t"));
+    CHECK(run("exec led -t 99999999999999999999", "Missing or invalid value for -t"));
+    CHECK(run("exec led -p -1", "Missing or invalid value for -p"));
+    CHECK(run("stop", ""));
+    CHECK(run("exec led", "Scheduler is stopped."));
+    CHECK(run("start", ""));
+    CHECK(run("  exec\tled  -t 200 ", ""));
+    CHECK(taskList[task_registry_find("led")].active);
+    CHECK(run("halt led", ""));
+    CHECK(!taskList[task_registry_find("led")].active);
+}
+
+int main() {
+    host_reset();
+    setup();
+    test_hash();
+    test_parse();
+    return check_result();
+}
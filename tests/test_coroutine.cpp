@@ -0,0 +1,87 @@
+#include "check.h"
+#include "host.h"
+#include "coroutine.h"
+
+// The timed primitives driven by hand, without the scheduler: each call
+// is one dispatch, and the virtual clock is moved between them
+
+static bool ready;     // the condition waited for
+static bool gotIt;     // cond as CO_WAIT_EVENT_FOR left it
+static int steps;      // how far the body got
+
+static uint8_t waiter(Coroutine* co) {
+    CO_BEGIN(co);
+    steps = 1;
+    CO_WAIT_EVENT_FOR(co, ready, 50);
+    gotIt = ready;
+    steps = 2;
+    CO_END(co);
+}
+
+static uint8_t sleeper(Coroutine* co) {
+    CO_BEGIN(co);
+    steps = 1;
+    CO_SLEEP_FOR(co, 20);
+    steps = 2;
+    CO_SLEEP_FOR(co, 0);
+    steps = 3;
+    CO_END(co);
+}
+
+// The event comes before the timeout: the body goes on with cond true
+static void test_wait_event() {
+    Coroutine co = { 0, 0 };
+    ready = false;
+    steps = 0;
+    unsigned long start = hal_millis();
+    CHECK_EQ(waiter(&co), CO_EVENT);
+    CHECK_EQ(steps, 1);
+    CHECK_EQ(co.wakeAt, start + 50);
+    // Woken early with nothing there: still waiting, the deadline unchanged
+    host_advance_us(20000);
+    CHECK_EQ(waiter(&co), CO_EVENT);
+    CHECK_EQ(co.wakeAt, start + 50);
+    ready = true;
+    CHECK_EQ(waiter(&co), CO_ENDED);
+    CHECK(gotIt);
+    CHECK_EQ(steps, 2);
+    CHECK_EQ(co.resume, 0);
+}
+
+// Nothing comes: once ms have passed it goes on with cond false
+static void test_wait_timeout() {
+    Coroutine co = { 0, 0 };
+    ready = false;
+    gotIt = true;
+    CHECK_EQ(waiter(&co), CO_EVENT);
+    host_advance_us(49000);
+    CHECK_EQ(waiter(&co), CO_EVENT);
+    host_advance_us(2000);
+    CHECK_EQ(waiter(&co), CO_ENDED);
+    CHECK(!gotIt);
+    CHECK_EQ(steps, 2);
+}
+
+// A sleep returns until wakeAt; a zero sleep does not stop at all
+static void test_sleep() {
+    Coroutine co = { 0, 0 };
+    steps = 0;
+    unsigned long start = hal_millis();
+    CHECK_EQ(sleeper(&co), CO_SLEEPING);
+    CHECK_EQ(steps, 1);
+    CHECK_EQ(co.wakeAt, start + 20);
+    host_advance_us(19000);
+    CHECK_EQ(sleeper(&co), CO_SLEEPING);
+    CHECK_EQ(steps, 1);
+    host_advance_us(1000);
+    CHECK_EQ(sleeper(&co), CO_ENDED);
+    CHECK_EQ(steps, 3);
+}
+
+int main() {
+    host_reset();
+    test_wait_event();
+    test_wait_timeout();
+    test_sleep();
+    return check_result();
+}
@@ -0,0 +1,107 @@
+#include "check.h"
+#include "dispatch_queue.h"
+#include "scheduler.h"
+
+static void admit(int index, unsigned long start, int priority) {
+    memset(&taskList[index], 0, sizeof(ScheduledTask));
+    taskList[index].period = 100 / TASK_TICK_MS;
+    taskList[index].startTime = start;
+    taskList[index].priority = priority;
+    taskList[index].active = 1;
+    dispatch_insert(index);
+}
+
+static void test_release_order() {
+    dispatch_init();
+    admit(0, 30, 1);
+    admit(1, 10, 1);
+    admit(2, 20, 1);
+
+    unsigned long release = 0;
+    CHECK(dispatch_next_release(&release));
+    CHECK_EQ(release, 10);
+    CHECK_EQ(dispatch_next(5), -1);
+    CHECK_EQ(dispatch_next(10), 1);
+    CHECK_EQ(dispatch_next(25), 2);
+    CHECK_EQ(dispatch_next(25), -1);
+    CHECK_EQ(dispatch_next(30), 0);
+    CHECK(!dispatch_next_release(&release));
+}
+
+static void test_ready_order() {
+    dispatch_init();
+    admit(0, 0, 1);
+    admit(1, 0, 3);
+    admit(2, 0, 2);
+    // Under EDF the deadlines are equal, so priority decides there too
+    CHECK_EQ(dispatch_next(0), 1);
+    CHECK_EQ(dispatch_next(0), 2);
+    CHECK_EQ(dispatch_next(0), 0);
+}
+
+static void test_wrap() {
+    // Release times straddling the millis() wrap still order by age
+    dispatch_init();
+    admit(0, (unsigned long)-16, 1);
+    admit(1, 16, 1);
+    CHECK_EQ(dispatch_next((unsigned long)-16), 0);
+    CHECK_EQ(dispatch_next((unsigned long)-8), -1);
+    CHECK_EQ(dispatch_next(16), 1);
+}
+
+static void test_remove_and_preempt() {
+    dispatch_init();
+    admit(0, 0, 1);
+    admit(1, 50, 5);
+    admit(2, 0, 2);
+    dispatch_remove(2);
+    CHECK_EQ(dispatch_next(0), 0);
+
+    // Task 0 runs; task 1 is not released yet
+    CHECK(!dispatch_preempts(0, 10, false));
+#if SCHED_POLICY == SCHED_EDF
+    // Released, but its deadline is later
+    CHECK(!dispatch_preempts(0, 50, false));
+#else
+    // Released and of higher priority
+    CHECK(dispatch_preempts(0, 50, false));
+#endif
+    // Equal rank only takes over when the slice is over
+    dispatch_remove(1);
+    taskList[1].priority = 1;
+    taskList[1].startTime = 0;
+    dispatch_insert(1);
+    CHECK(!dispatch_preempts(0, 60, false));
+    CHECK(dispatch_preempts(0, 60, true));
+}
+
+// Period 0 is background work: behind any periodic task, whatever its
+// priority, and it never takes the CPU from one
+static void test_background() {
+    dispatch_init();
+    admit(0, 0, 1);
+    admit(1, 0, 9);
+    dispatch_remove(1);
+    taskList[1].period = 0;
+    dispatch_insert(1);
+    admit(2, 0, 5);
+    dispatch_remove(2);
+    taskList[2].period = 0;
+    dispatch_insert(2);
+    CHECK_EQ(dispatch_next(0), 0);
+    CHECK(!dispatch_preempts(0, 0, true));
+    // Among themselves, by the policy
+    CHECK_EQ(dispatch_next(0), 1);
+    CHECK_EQ(dispatch_next(0), 2);
+    dispatch_insert(0);
+    CHECK(dispatch_preempts(2, 0, false));
+}
+
+int main() {
+    test_release_order();
+    test_ready_order();
+    test_wrap();
+    test_remove_and_preempt();
+    test_background();
+    return check_result();
+}
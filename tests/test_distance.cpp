@@ -0,0 +1,113 @@
+#include "check.h"
+#include "host.h"
+#include "distance_task.h"
+#include "ranging.h"
+#include "sensor_log.h"
+
+// The distance task against a simulated HC-SR04, then with the logger
+
+void setup();
+void loop();
+
+#define TRIG_PIN 9
+#define ECHO_PIN 8
+#define ECHO_DELAY_US 400
+#define ECHO_WIDTH_US 580  // about 10 cm
+
+// Echo widths for the next triggers, in order; 0 is no echo at all.
+// Past the end the sensor answers with ECHO_WIDTH_US.
+static const unsigned int* script = NULL;
+static unsigned int scriptLength = 0;
+static unsigned int triggers = 0;
+
+static void command(const char* line) {
+    host_console_input(line);
+    host_run(loop, 10);
+}
+
+static void echo_rise(void*) { host_pin_drive(ECHO_PIN, true); }
+static void echo_fall(void*) { host_pin_drive(ECHO_PIN, false); }
+
+// A trigger pulse's falling edge starts the echo
+static void sensor(uint8_t pin, bool high) {
+    static bool triggered = false;
+    if (pin != TRIG_PIN) return;
+    if (triggered && !high) {
+        unsigned int width = triggers < scriptLength ? script[triggers] : ECHO_WIDTH_US;
+        triggers++;
+        if (width != 0) {
+            unsigned long long now = host_now_us();
+            host_at(now + ECHO_DELAY_US, echo_rise, NULL);
+            host_at(now + ECHO_DELAY_US + width, echo_fall, NULL);
+        }
+    }
+    triggered = high;
+}
+
+// Runs the task for count measurements, 100 ms apart, and collects the
+// readings it published
+static unsigned int measure(const unsigned int* widths, unsigned int count, uint16_t* cm) {
+    script = widths;
+    scriptLength = count;
+    triggers = 0;
+    command("exec distance -t 100");
+    while (triggers < count) host_run(loop, 10);
+    host_run(loop, 50);
+    command("halt distance");
+    script = NULL;
+    scriptLength = 0;
+
+    unsigned int got = 0;
+    for (const DistanceSample* sample; (sample = distanceReadings.peek()) != NULL; distanceReadings.release()) {
+        if (got < count) cm[got] = sample->cm;
+        got++;
+    }
+    return got;
+}
+
+// One wild echo among good ones does not reach the readings
+static void test_median() {
+    static const unsigned int widths[] = { 580, 580, 5800, 580, 580 };
+    uint16_t cm[5];
+    CHECK_EQ(ranging_us_to_cm(5800), 98);
+    CHECK_EQ(measure(widths, 5, cm), 5);
+    for (int i = 0; i < 5; i++) CHECK_EQ(cm[i], ranging_us_to_cm(580));
+}
+
+// No echo: the measurement times out, publishes nothing, and the next
+// trigger works again
+static void test_missing_echo() {
+    static const unsigned int widths[] = { 0, 0, 580 };
+    uint16_t cm[3];
+    unsigned long long start = host_now_us();
+    CHECK_EQ(measure(widths, 3, cm), 1);
+    CHECK_EQ(cm[0], ranging_us_to_cm(580));
+    CHECK_EQ(ranging_echo_us() / 10, 58);
+    // Each timeout ended the job, so the releases kept their 100 ms pace
+    CHECK(host_now_us() - start < 400000ULL);
+}
+
+static void test_log() {
+    command("exec distance -t 100");
+    command("exec logger");
+    host_run(loop, 20000);
+    command("stop");
+    host_console_output().clear();
+    command("LOGCSV");
+    CHECK(host_console_output().find("Exported 20") != std::string::npos);
+
+    std::string csv;
+    CHECK(host_sd_get(SENSOR_LOG_CSV, &csv));
+    CHECK(csv.compare(0, 14, "millis,value\r\n") == 0);
+    CHECK(csv.find(",10\r\n") != std::string::npos || csv.find(",9\r\n") != std::string::npos);
+}
+
+int main() {
+    host_reset();
+    setup();
+    host_on_pin_write(sensor);
+    test_median();
+    test_missing_echo();
+    test_log();
+    return check_result();
+}
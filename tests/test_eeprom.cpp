@@ -0,0 +1,98 @@
+#include "check.h"
+#include "host.h"
+#include "eeprom.h"
+
+#include <string.h>
+
+static void fill(byte* data, unsigned int length, byte seed) {
+    for (unsigned int i = 0; i < length; i++) data[i] = (byte)(seed + i);
+}
+
+// A write across a page boundary is split there, so nothing rolls over to
+// the start of the first page
+static void test_page_straddle() {
+    byte data[20];
+    fill(data, sizeof(data), 1);
+    unsigned long writes = hostStats.eepromWrites;
+    CHECK(writeEEPROMBlock(EEPROM_PAGE_SIZE - 8, data, sizeof(data)));
+    CHECK_EQ(hostStats.eepromWrites - writes, 2);
+    CHECK(memcmp(host_eeprom() + EEPROM_PAGE_SIZE - 8, data, sizeof(data)) == 0);
+    CHECK_EQ(host_eeprom()[0], 0xFF);
+    CHECK_EQ(host_eeprom()[EEPROM_PAGE_SIZE - 9], 0xFF);
+    CHECK_EQ(host_eeprom()[EEPROM_PAGE_SIZE + 12], 0xFF);
+
+    // Longer than a transfer: also split at the I2C buffer limit
+    byte block[3 * EEPROM_PAGE_SIZE];
+    fill(block, sizeof(block), 7);
+    writes = hostStats.eepromWrites;
+    CHECK(writeEEPROMBlock(4 * EEPROM_PAGE_SIZE + 10, block, sizeof(block)));
+    unsigned int chunks = 0;
+    for (unsigned int offset = 0; offset < sizeof(block);) {
+        unsigned int address = 4 * EEPROM_PAGE_SIZE + 10 + offset;
+        unsigned int chunk = EEPROM_PAGE_SIZE - address % EEPROM_PAGE_SIZE;
+        if (chunk > EEPROM_WIRE_CHUNK) chunk = EEPROM_WIRE_CHUNK;
+        offset += chunk;
+        chunks++;
+    }
+    CHECK_EQ(hostStats.eepromWrites - writes, chunks);
+    byte back[sizeof(block)];
+    CHECK(readEEPROMBlock(4 * EEPROM_PAGE_SIZE + 10, back, sizeof(back)));
+    CHECK(memcmp(back, block, sizeof(block)) == 0);
+}
+
+// A write returns once the page is sent; the next access polls the ACK
+// until the write cycle is over instead of waiting a fixed time
+static void test_read_during_write_cycle() {
+    byte data[8];
+    fill(data, sizeof(data), 40);
+    CHECK(waitEEPROMReady());
+    unsigned long long start = host_now_us();
+    CHECK(writeEEPROMBlock(1000, data, sizeof(data)));
+    unsigned long long written = host_now_us();
+    CHECK(written - start < HOST_EEPROM_WRITE_US);
+
+    unsigned long transactions = hostStats.i2cTransactions;
+    byte back[sizeof(data)];
+    CHECK(readEEPROMBlock(1000, back, sizeof(back)));
+    CHECK(memcmp(back, data, sizeof(data)) == 0);
+    // Several NACKed probes, then the address and the read
+    CHECK(hostStats.i2cTransactions - transactions > 3);
+    CHECK(host_now_us() - start >= HOST_EEPROM_WRITE_US);
+    // Done polling: the next read goes straight out
+    transactions = hostStats.i2cTransactions;
+    CHECK_EQ(readEEPROM(1003), 43);
+    CHECK_EQ(hostStats.i2cTransactions - transactions, 2);
+
+    // Back to back writes wait for each other's cycle
+    writeEEPROM(2000, 1);
+    writeEEPROM(2001, 2);
+    CHECK_EQ(readEEPROM(2000), 1);
+    CHECK_EQ(readEEPROM(2001), 2);
+}
+
+// A chip that never answers times out instead of hanging
+static void test_missing_chip() {
+    byte data[4];
+    fill(data, sizeof(data), 0);
+    host_eeprom_fail(true);
+    CHECK(!writeEEPROMBlock(3000, data, sizeof(data)));
+    CHECK_EQ(readEEPROM(3000), 0xFF);
+    host_eeprom_fail(false);
+
+    // A write issued just before it failed leaves a poll that runs out
+    CHECK(writeEEPROMBlock(3000, data, sizeof(data)));
+    host_eeprom_fail(true);
+    unsigned long long start = host_now_us();
+    CHECK(!waitEEPROMReady());
+    CHECK(host_now_us() - start >= (EEPROM_WRITE_TIMEOUT - 1) * 1000ULL);  // whole ms
+    host_eeprom_fail(false);
+    CHECK(waitEEPROMReady());
+}
+
+int main() {
+    host_reset();
+    test_page_straddle();
+    test_read_during_write_cycle();
+    test_missing_chip();
+    return check_result();
+}
@@ -0,0 +1,254 @@
+#include "check.h"
+#include "host.h"
+#include "filesystem.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// Puts a file of length bytes, byte i being seed + i
+static void put_pattern(const char* name, unsigned int length, byte seed) {
+    std::string data;
+    for (unsigned int i = 0; i < length; i++) data += (char)(byte)(seed + i);
+    host_sd_put(name, data.data(), data.size());
+}
+
+static bool is_pattern(const byte* data, unsigned int length, unsigned long offset, byte seed) {
+    for (unsigned int i = 0; i < length; i++) {
+        if (data[i] != (byte)(seed + offset + i)) return false;
+    }
+    return true;
+}
+
+// The card as inserted: exactly as many files as the index holds. The
+// kernel indexes them at the first mount and does not expect files to
+// appear behind its back until it mounts again.
+static void card_fixtures() {
+    put_pattern("READ.BIN", 100, 1);
+    put_pattern("FIRST.BIN", 64, 10);
+    put_pattern("SECOND.BIN", 64, 200);
+    put_pattern("EVICT.BIN", FS_CACHE_LINE * (FS_CACHE_LINES + 1), 50);
+    for (int i = 4; i < FS_INDEX_SIZE; i++) {
+        char name[FS_NAME_MAX + 1];
+        snprintf(name, sizeof(name), "PAD%d.BIN", i);
+        put_pattern(name, 1, 0);
+    }
+}
+
+// While every root entry fits, lookups never touch the card; once one
+// does not, names missing from the index are asked of the card
+static void test_index() {
+    unsigned long ops = hostStats.sdOps;
+    CHECK(initSDCard());
+    CHECK(hostStats.sdOps > ops);  // mount and directory listing
+
+    ops = hostStats.sdOps;
+    CHECK(fs_exists("READ.BIN"));
+    CHECK(fs_exists("/read.bin"));
+    CHECK_EQ(fs_size("EVICT.BIN"), FS_CACHE_LINE * (FS_CACHE_LINES + 1));
+    CHECK(!fs_exists("NONE.BIN"));
+    CHECK_EQ(fs_size("NONE.BIN"), -1);
+    CHECK_EQ(fs_open("NONE.BIN", FS_READ), FS_NO_FILE);
+    CHECK_EQ(hostStats.sdOps, ops);
+
+    // One entry more than the index holds
+    FsFile file = fs_open("OVER.TXT", FS_WRITE);
+    CHECK(file != FS_NO_FILE);
+    CHECK_EQ(fs_append(file, "12345", 5), 5);
+    CHECK(fs_close(file));
+    ops = hostStats.sdOps;
+    CHECK(fs_exists("READ.BIN"));
+    CHECK_EQ(hostStats.sdOps, ops);
+    CHECK(fs_exists("OVER.TXT"));
+    CHECK_EQ(fs_size("OVER.TXT"), 5);
+    CHECK(!fs_exists("NONE.BIN"));
+    CHECK(hostStats.sdOps - ops >= 3);
+
+    // Removing it goes to the card as well
+    CHECK(fs_remove("OVER.TXT"));
+    CHECK(!fs_exists("OVER.TXT"));
+    std::string data;
+    CHECK(!host_sd_get("OVER.TXT", &data));
+}
+
+static void test_read_through() {
+    FsFile file = fs_open("READ.BIN", FS_READ);
+    CHECK(file != FS_NO_FILE);
+    byte data[FS_CACHE_LINE * 2];
+
+    // A read inside one line loads it once; the rest of the line is a hit
+    unsigned long misses = fsCacheStats.misses;
+    unsigned long hits = fsCacheStats.hits;
+    CHECK_EQ(fs_read_at(file, 3, data, 4), 4);
+    CHECK(is_pattern(data, 4, 3, 1));
+    CHECK_EQ(fsCacheStats.misses - misses, 1);
+    CHECK_EQ(fs_read_at(file, 10, data, 8), 8);
+    CHECK(is_pattern(data, 8, 10, 1));
+    CHECK_EQ(fsCacheStats.hits - hits, 1);
+
+    // Across a line boundary: the cached line, then one miss
+    misses = fsCacheStats.misses;
+    CHECK_EQ(fs_read_at(file, 20, data, 30), 30);
+    CHECK(is_pattern(data, 30, 20, 1));
+    CHECK_EQ(fsCacheStats.misses - misses, 1);
+
+    // Short at the end of the file, nothing past it
+    CHECK_EQ(fs_read_at(file, 90, data, 20), 10);
+    CHECK(is_pattern(data, 10, 90, 1));
+    CHECK_EQ(fs_read_at(file, 100, data, 4), 0);
+    CHECK(fs_close(file));
+}
+
+static void test_append_sync() {
+    FsFile file = fs_open("APPEND.TXT", FS_WRITE);
+    CHECK(file != FS_NO_FILE);
+    unsigned long writeBacks = fsCacheStats.writeBacks;
+
+    // Short appends collect in a line and do not reach the card
+    CHECK_EQ(fs_append(file, "abc", 3), 3);
+    CHECK_EQ(fs_append(file, "defg", 4), 4);
+    std::string data;
+    CHECK(host_sd_get("APPEND.TXT", &data));
+    CHECK_EQ(data.size(), 0);
+    CHECK_EQ(fs_length(file), 7);
+    CHECK_EQ(fs_size("APPEND.TXT"), 0);
+
+    // sync writes the line once and records the size in the index
+    CHECK(fs_sync(file));
+    CHECK_EQ(fsCacheStats.writeBacks - writeBacks, 1);
+    CHECK(host_sd_get("APPEND.TXT", &data));
+    CHECK(data == "abcdefg");
+    CHECK_EQ(fs_size("APPEND.TXT"), 7);
+
+    // A full line goes out on its own, the tail waits for close
+    byte block[FS_CACHE_LINE + 5];
+    for (unsigned int i = 0; i < sizeof(block); i++) block[i] = (byte)('A' + i % 26);
+    writeBacks = fsCacheStats.writeBacks;
+    CHECK_EQ(fs_append(file, block, sizeof(block)), sizeof(block));
+    CHECK_EQ(fsCacheStats.writeBacks - writeBacks, 1);
+    CHECK(host_sd_get("APPEND.TXT", &data));
+    CHECK_EQ(data.size(), 7 + FS_CACHE_LINE);
+
+    // Reading back flushes what is cached first
+    byte back[sizeof(block)];
+    CHECK_EQ(fs_read_at(file, 7, back, sizeof(back)), sizeof(back));
+    CHECK(memcmp(back, block, sizeof(block)) == 0);
+    CHECK(fs_close(file));
+    CHECK(host_sd_get("APPEND.TXT", &data));
+    CHECK_EQ(data.size(), 7 + sizeof(block));
+    CHECK_EQ(fs_size("APPEND.TXT"), 7 + sizeof(block));
+}
+
+// A slot reused by another file must not serve the old file's lines, and
+// the old handle must not reach the new file
+static void test_handle_reuse() {
+    byte data[8];
+
+    FsFile first = fs_open("FIRST.BIN", FS_READ);
+    CHECK(first != FS_NO_FILE);
+    CHECK_EQ(fs_read_at(first, 0, data, sizeof(data)), sizeof(data));
+    CHECK(is_pattern(data, sizeof(data), 0, 10));
+    CHECK(fs_close(first));
+
+    FsFile second = fs_open("SECOND.BIN", FS_READ);
+    CHECK(second != FS_NO_FILE);
+    CHECK(second != first);
+    unsigned long misses = fsCacheStats.misses;
+    CHECK_EQ(fs_read_at(second, 0, data, sizeof(data)), sizeof(data));
+    CHECK(is_pattern(data, sizeof(data), 0, 200));
+    CHECK_EQ(fsCacheStats.misses - misses, 1);
+
+    CHECK(!fs_is_open(first));
+    CHECK_EQ(fs_read_at(first, 0, data, sizeof(data)), -1);
+    CHECK_EQ(fs_append(first, "x", 1), 0);
+    CHECK(!fs_close(first));
+    CHECK(fs_close(second));
+    std::string stored;
+    CHECK(host_sd_get("SECOND.BIN", &stored));
+    CHECK_EQ(stored.size(), 64);
+}
+
+// With every line in use, the least recently used one goes first
+static void test_eviction() {
+    FsFile file = fs_open("EVICT.BIN", FS_READ);
+    byte data[4];
+    for (int line = 0; line < FS_CACHE_LINES; line++) {
+        CHECK_EQ(fs_read_at(file, line * FS_CACHE_LINE, data, sizeof(data)), sizeof(data));
+    }
+    // Line 0 is used again, so loading one more line evicts line 1
+    CHECK_EQ(fs_read_at(file, 0, data, sizeof(data)), sizeof(data));
+    CHECK_EQ(fs_read_at(file, FS_CACHE_LINES * FS_CACHE_LINE, data, sizeof(data)), sizeof(data));
+    unsigned long hits = fsCacheStats.hits;
+    CHECK_EQ(fs_read_at(file, 0, data, sizeof(data)), sizeof(data));
+    CHECK(is_pattern(data, sizeof(data), 0, 50));
+    CHECK_EQ(fsCacheStats.hits - hits, 1);
+    unsigned long misses = fsCacheStats.misses;
+    CHECK_EQ(fs_read_at(file, FS_CACHE_LINE, data, sizeof(data)), sizeof(data));
+    CHECK(is_pattern(data, sizeof(data), FS_CACHE_LINE, 50));
+    CHECK_EQ(fsCacheStats.misses - misses, 1);
+    CHECK(fs_close(file));
+}
+
+// Closing and reopening the same file gives a new handle; the old one is
+// refused although it names the same slot and file
+static void test_stale_handle() {
+    byte data[4];
+    FsFile old = fs_open("READ.BIN", FS_READ);
+    CHECK(old != FS_NO_FILE);
+    CHECK(fs_close(old));
+    FsFile file = fs_open("READ.BIN", FS_READ);
+    CHECK(file != FS_NO_FILE);
+    CHECK(file != old);
+    CHECK(!fs_is_open(old));
+    CHECK_EQ(fs_read_at(old, 0, data, sizeof(data)), -1);
+    CHECK_EQ(fs_length(old), 0);
+    CHECK(!fs_sync(old));
+    CHECK(!fs_close(old));
+    CHECK_EQ(fs_read_at(file, 0, data, sizeof(data)), sizeof(data));
+    CHECK(is_pattern(data, sizeof(data), 0, 1));
+    CHECK(fs_close(file));
+}
+
+// A card that stops answering is mounted again on the next access; the
+// index is rebuilt from the card, and handles and cached lines from before
+// are dropped
+static void test_remount() {
+    byte data[4];
+    FsFile file = fs_open("READ.BIN", FS_READ);
+    CHECK_EQ(fs_read_at(file, 0, data, sizeof(data)), sizeof(data));
+
+    host_sd_present(false);
+    // The first line is cached, the card is needed for the next
+    CHECK_EQ(fs_read_at(file, FS_CACHE_LINE, data, sizeof(data)), -1);
+    CHECK_EQ(fs_open("FIRST.BIN", FS_READ), FS_NO_FILE);  // known file fails: remount
+    CHECK(!fs_exists("READ.BIN"));
+    CHECK(!initSDCard());
+
+    // Changed while it was out
+    put_pattern("LATER.BIN", 10, 0);
+    host_sd_present(true);
+    CHECK(fs_exists("LATER.BIN"));
+    CHECK_EQ(fs_size("LATER.BIN"), 10);
+    CHECK(!fs_is_open(file));
+    unsigned long misses = fsCacheStats.misses;
+    CHECK_EQ(fs_read_at(file, 0, data, sizeof(data)), -1);
+    FsFile again = fs_open("READ.BIN", FS_READ);
+    CHECK(again != FS_NO_FILE);
+    CHECK(!fs_is_open(file));
+    CHECK_EQ(fs_read_at(again, 0, data, sizeof(data)), sizeof(data));
+    CHECK(is_pattern(data, sizeof(data), 0, 1));
+    CHECK_EQ(fsCacheStats.misses - misses, 1);
+    CHECK(fs_close(again));
+}
+
+int main() {
+    host_reset();
+    card_fixtures();
+    test_index();
+    test_read_through();
+    test_append_sync();
+    test_handle_reuse();
+    test_eviction();
+    test_stale_handle();
+    test_remount();
+    return check_result();
+}
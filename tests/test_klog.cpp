@@ -0,0 +1,58 @@
+#include "check.h"
+#include "host.h"
+#include "klog.h"
+
+static bool printed(const char* text) {
+    return host_console_output().find(text) != std::string::npos;
+}
+
+// klog_drain() only fills the room the console has; give it line time
+static void drain_all() {
+    for (int i = 0; i < 1000 && klog_pending(); i++) {
+        klog_drain();
+        host_advance_us(1000);
+    }
+}
+
+static void test_level_filter() {
+    host_console_output().clear();
+    klogLevel = KLOG_ERROR;
+    klog_task(KLOG_SWAP_OUT, 0);
+    CHECK(!klog_pending());
+    klog_task(KLOG_SWAP_WRITE_FAIL, 0);
+    CHECK(klog_pending());
+    drain_all();
+    CHECK(!klog_pending());
+    CHECK(printed("EEPROM write failed for task: "));
+}
+
+static void test_overflow() {
+    host_console_output().clear();
+    klogLevel = KLOG_INFO;
+    unsigned int dropped = klogDropped;
+    for (uint16_t i = 0; i < KLOG_RING + 2; i++) {
+        klog_value(KLOG_DISTANCE, 100 + i);
+    }
+    CHECK_EQ(klogDropped - dropped, 2);
+    drain_all();
+    CHECK(!klog_pending());
+    // The drop count comes first, then the records that fit, oldest first
+    std::string& out = host_console_output();
+    size_t drops = out.find("[log] dropped 2\r\n");
+    size_t first = out.find("Distance: 100 cm\r\n");
+    char newest[32];
+    snprintf(newest, sizeof(newest), "Distance: %d cm\r\n", 100 + KLOG_RING - 1);
+    size_t last = out.find(newest);
+    CHECK(drops != std::string::npos);
+    CHECK(first != std::string::npos && first > drops);
+    CHECK(last != std::string::npos && last > first);
+    snprintf(newest, sizeof(newest), "Distance: %d cm", 100 + KLOG_RING);
+    CHECK(!printed(newest));
+}
+
+int main() {
+    host_reset();
+    test_level_filter();
+    test_overflow();
+    return check_result();
+}
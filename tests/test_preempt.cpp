@@ -0,0 +1,108 @@
+#include "check.h"
+#include "host.h"
+#include "preempt.h"
+#include "scheduler.h"
+#include "task_registry.h"
+#include "task_stats.h"
+
+// Preemptive build: a long led job is interrupted by distance, released
+// at a higher priority, and resumes afterwards. The led job is made long
+// by its pin write, which the observer below stretches on the virtual
+// clock, as a slow peripheral would. No sensor answers, so every distance
+// job ends at its echo timeout and the next one starts at a release.
+
+void setup();
+void loop();
+
+#define TRIG_PIN 9
+#define STALL_STEP_US 500
+
+static bool triggered;
+static unsigned long stallUs;         // length of the next led job
+static bool stallLocked;              // with preemption held off for the first half
+static bool inLedJob;
+static unsigned long triggersInJob;   // distance jobs started during a led job
+static unsigned long triggersLocked;  // of those, while preemption was held off
+static unsigned long long unlockedAt;
+static unsigned long long firstAfterUnlock;
+
+static void command(const char* line) {
+    host_console_input(line);
+    host_run(loop, 10);
+}
+
+static void stall(unsigned long us) {
+    for (unsigned long spent = 0; spent < us; spent += STALL_STEP_US) hal_delay_us(STALL_STEP_US);
+}
+
+static void observer(uint8_t pin, bool high) {
+    if (pin == TRIG_PIN) {
+        // A trigger pulse's falling edge starts a distance job
+        if (triggered && !high) {
+            if (inLedJob) triggersInJob++;
+            if (inLedJob && stallLocked && unlockedAt == 0) triggersLocked++;
+            if (unlockedAt != 0 && firstAfterUnlock == 0) firstAfterUnlock = host_now_us();
+        }
+        triggered = high;
+    } else if (pin == LED_BUILTIN && stallUs != 0) {
+        unsigned long us = stallUs;
+        stallUs = 0;
+        inLedJob = true;
+        if (stallLocked) {
+            preempt_lock();
+            stall(us / 2);
+            unlockedAt = host_now_us();
+            preempt_unlock();
+            stall(us / 2);
+        } else {
+            stall(us);
+        }
+        inLedJob = false;
+    }
+}
+
+static void run_led_job(unsigned long us, bool locked) {
+    triggersInJob = 0;
+    triggersLocked = 0;
+    unlockedAt = 0;
+    firstAfterUnlock = 0;
+    stallLocked = locked;
+    stallUs = us;
+    command("exec led -t 1000 -p 1 -f");
+    for (int ms = 0; ms < 1000 && (stallUs != 0 || inLedJob); ms += 10) host_run(loop, 10);
+    command("halt led");
+}
+
+// distance (every 40 ms) runs inside a 100 ms led job, and led still finishes
+static void test_preempted() {
+    int led = task_registry_find("led");
+    command("exec distance -t 40 -p 9 -f");
+    unsigned long jobs = taskStats[led].jobs;
+    run_led_job(100000, false);
+    CHECK(!inLedJob);
+    CHECK(triggersInJob >= 2);
+    CHECK(taskStats[led].jobs > jobs);
+    CHECK(preempt_stack_used(led) > 0);
+    command("halt distance");
+}
+
+// Held off by preempt_lock(), distance waits for preempt_unlock() and
+// then runs at once, not at the next tick
+static void test_locked() {
+    command("exec distance -t 40 -p 9 -f");
+    run_led_job(100000, true);
+    CHECK(!inLedJob);
+    CHECK_EQ(triggersLocked, 0);
+    CHECK(triggersInJob >= 1);
+    CHECK(firstAfterUnlock >= unlockedAt && firstAfterUnlock - unlockedAt < 1000);
+    command("halt distance");
+}
+
+int main() {
+    host_reset();
+    setup();
+    host_on_pin_write(observer);
+    test_preempted();
+    test_locked();
+    return check_result();
+}
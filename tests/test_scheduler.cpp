@@ -0,0 +1,104 @@
+#include "check.h"
+#include "host.h"
+#include "kernel_config.h"
+#include "scheduler.h"
+#include "task_registry.h"
+
+// The whole kernel, setup() and loop(), against the simulated board
+
+void setup();
+void loop();
+
+static void command(const char* line) {
+    host_console_input(line);
+    host_run(loop, 10);
+}
+
+static void test_led() {
+    unsigned long toggles = host_pin_writes(LED_BUILTIN);
+    command("exec led -t 50");
+    host_run(loop, 1000);
+    toggles = host_pin_writes(LED_BUILTIN) - toggles;
+    // One toggle per release, 21 in the window; the snapshot exec saves
+    // can make the first release late enough to add a catch-up one
+    CHECK(toggles >= 20 && toggles <= 22);
+    command("halt led");
+}
+
+// The preemptive build wakes on its 1 ms tick instead
+#if !KERNEL_PREEMPTIVE
+static void test_idle() {
+    HostStats before = hostStats;
+    host_run(loop, 10000);
+    // Nothing admitted: only the longest tickless sleep ends a sleep
+    CHECK(hostStats.sleeps - before.sleeps <= 10000000UL / HOST_TICKLESS_MAX_US + 2);
+    CHECK(hostStats.sleptUs - before.sleptUs > 9990000ULL);
+
+    // One wakeup per release, not one per 1.024 ms Timer0 tick
+    command("exec led -t 100");
+    before = hostStats;
+    host_run(loop, 10000);
+    CHECK(hostStats.sleeps - before.sleeps <= 110);
+    CHECK(hostStats.sleptUs - before.sleptUs > 9900000ULL);
+    command("halt led");
+}
+#endif
+
+static void test_clean_swap() {
+    command("stop");
+    int led = task_registry_find("led");
+    swap_out_task(led);
+    swap_in_task(led);
+    // Nothing changed while it was resident: no new record
+    unsigned long clean = swapStats.cleanSwapOuts;
+    swap_out_task(led);
+    CHECK_EQ(swapStats.cleanSwapOuts - clean, 1);
+
+    // A re-key while swapped writes the record as a resident image, so
+    // the next swap-out after it comes back is still clean
+    scheduler_add_task("led", 200, taskList[led].priority, false);
+    swap_in_task(led);
+    CHECK_EQ(task_period_ms(&taskList[led]), 200);
+    swap_out_task(led);
+    CHECK_EQ(swapStats.cleanSwapOuts - clean, 2);
+    swap_in_task(led);
+}
+
+// A swapped task released while the count says RAM is full, with no
+// other task resident to evict, stays in EEPROM and is retried instead
+// of going over MAX_TASKS
+static void test_no_room() {
+    int led = task_registry_find("led");
+    command("exec led -t 50");
+    command("stop");
+    swap_out_task(led);
+    activeTaskCount = MAX_TASKS;
+    unsigned long toggles = host_pin_writes(LED_BUILTIN);
+    host_console_output().clear();
+    command("start");
+    // Long enough for the console to catch up with the log
+    host_run(loop, 1000);
+    CHECK(taskList[led].swapped);
+    CHECK_EQ(host_pin_writes(LED_BUILTIN), toggles);
+    CHECK(host_console_output().find("No RAM slot to swap in task: led") != std::string::npos);
+
+    // Once there is room it is swapped in at the next retry
+    activeTaskCount = 0;
+    host_run(loop, SWAP_IN_RETRY_MS + 10);
+    CHECK(!taskList[led].swapped);
+    CHECK_EQ(activeTaskCount, 1);
+    CHECK(host_pin_writes(LED_BUILTIN) > toggles);
+    command("halt led");
+}
+
+int main() {
+    host_reset();
+    setup();
+    test_led();
+#if !KERNEL_PREEMPTIVE
+    test_idle();
+#endif
+    test_clean_swap();
+    test_no_room();
+    return check_result();
+}
@@ -0,0 +1,136 @@
+#include "check.h"
+#include "host.h"
+#include "snapshot.h"
+#include "scheduler.h"
+#include "task_registry.h"
+#include "bluetooth_transfer.h"
+
+// Saves and restores across simulated resets: scheduler_init() forgets
+// everything in RAM, the EEPROM keeps its contents
+
+static int led, distance;
+
+static bool reboot() {
+    scheduler_init();
+    return snapshot_restore();
+}
+
+static SnapshotHeader read_header(byte slot) {
+    SnapshotHeader header;
+    memcpy(&header, host_eeprom() + SNAPSHOT_BASE + slot * SNAPSHOT_SLOT_SIZE, sizeof(header));
+    return header;
+}
+
+// The slot with the newest valid generation, as restore picks it
+static byte newest_slot() {
+    SnapshotHeader a = read_header(0);
+    SnapshotHeader b = read_header(1);
+    if (a.magic != SNAPSHOT_MAGIC) return 1;
+    if (b.magic != SNAPSHOT_MAGIC) return 0;
+    return (int16_t)(a.generation - b.generation) > 0 ? 0 : 1;
+}
+
+// Rewrites a slot's header the way another build would have written it
+static void rewrite_header(byte slot, uint16_t layoutXor) {
+    uint8_t* at = host_eeprom() + SNAPSHOT_BASE + slot * SNAPSHOT_SLOT_SIZE;
+    SnapshotHeader header;
+    memcpy(&header, at, sizeof(header));
+    header.layout ^= layoutXor;
+    uint16_t crc = bt_crc16(0xFFFF, &header.flags, 1);
+    crc = bt_crc16(crc, (const uint8_t*)&header.generation, sizeof(header.generation));
+    crc = bt_crc16(crc, (const uint8_t*)&header.layout, sizeof(header.layout));
+    header.crc = bt_crc16(crc, at + sizeof(header), SNAPSHOT_BODY_SIZE);
+    memcpy(at, &header, sizeof(header));
+}
+
+static void test_clean_restore() {
+    scheduler_init();
+    CHECK(!snapshot_restore());
+    // Admitting a task saves at once
+    scheduler_add_task("led", 100, 2, false);
+    scheduler_add_task("distance", 300, 4, false);
+
+    CHECK(reboot());
+    CHECK_EQ(activeTaskCount, 2);
+    CHECK(taskList[led].active);
+    CHECK_EQ(task_period_ms(&taskList[led]), 100);
+    CHECK_EQ(taskList[led].priority, 2);
+    CHECK(taskList[distance].active);
+    CHECK_EQ(task_period_ms(&taskList[distance]), 300);
+    CHECK_EQ(taskList[distance].priority, 4);
+    // Released now and from the top of its job
+    CHECK_EQ(taskList[led].co.resume, 0);
+}
+
+// A save cut off after the body but before the header leaves the older
+// snapshot in charge
+static void test_torn_write() {
+    scheduler_add_task("led", 200, 2, false);
+    byte older = newest_slot() ^ 1;
+    SnapshotHeader before = read_header(older);
+
+    scheduler_add_task("led", 400, 2, false);
+    CHECK_EQ(newest_slot(), older);
+    // Put the old header back over the new body, as if power went first
+    memcpy(host_eeprom() + SNAPSHOT_BASE + older * SNAPSHOT_SLOT_SIZE, &before, sizeof(before));
+
+    CHECK(reboot());
+    CHECK_EQ(task_period_ms(&taskList[led]), 200);
+
+    // A flipped body byte is caught the same way
+    scheduler_add_task("led", 500, 2, false);
+    CHECK_EQ(newest_slot(), older);
+    host_eeprom()[SNAPSHOT_BASE + older * SNAPSHOT_SLOT_SIZE + sizeof(SnapshotHeader) + 3] ^= 0x10;
+    CHECK(reboot());
+    CHECK_EQ(task_period_ms(&taskList[led]), 200);
+}
+
+// A snapshot from a build with another registry is ignored
+static void test_layout_mismatch() {
+    // Both slots written by this build
+    CHECK(snapshot_save());
+    CHECK(snapshot_save());
+    // Recomputing the CRC alone keeps it valid
+    rewrite_header(0, 0);
+    rewrite_header(1, 0);
+    CHECK(reboot());
+
+    rewrite_header(0, 0x0100);
+    rewrite_header(1, 0x0100);
+    CHECK(!reboot());
+    CHECK_EQ(activeTaskCount, 0);
+    CHECK(!taskList[led].active);
+}
+
+// With auto-restore off the tasks stay down, and the setting itself survives
+static void test_restore_off() {
+    scheduler_init();
+    scheduler_add_task("led", 100, 2, false);
+    // As the restore command does
+    snapshot_set_auto_restore(false);
+    CHECK(snapshot_save());
+
+    CHECK(!reboot());
+    CHECK_EQ(activeTaskCount, 0);
+    CHECK(!taskList[led].active);
+    host_console_output().clear();
+    snapshot_print();
+    CHECK(host_console_output().find("Auto-restore: off") != std::string::npos);
+
+    // Turned back on, the next snapshot restores again
+    snapshot_set_auto_restore(true);
+    scheduler_add_task("led", 100, 2, false);
+    CHECK(reboot());
+    CHECK(taskList[led].active);
+}
+
+int main() {
+    host_reset();
+    led = task_registry_find("led");
+    distance = task_registry_find("distance");
+    test_clean_restore();
+    test_torn_write();
+    test_layout_mismatch();
+    test_restore_off();
+    return check_result();
+}
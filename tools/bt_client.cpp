@@ -0,0 +1,237 @@
+// Host-side reference receiver for BTSEND (see bluetooth_transfer.h for the
+// frame format). Reads frames from a serial device such as /dev/rfcomm0,
+// checks CRC and sequence, answers ACK/NAK and writes the file locally.
+//
+//   g++ -O2 -o bt_client bt_client.cpp
+//   ./bt_client /dev/rfcomm0 [baud] [output-dir]
+//
+// Then issue `BTSEND <filename>` on the board's Serial console.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <string>
+
+// Must match bluetooth_transfer.h
+#define BT_SOH 0x01
+#define BT_ACK 0x06
+#define BT_NAK 0x15
+#define BT_CAN 0x18
+#define BT_FRAME_PAYLOAD 64
+
+static uint16_t bt_crc16(uint16_t crc, const uint8_t* data, size_t length) {
+    while (length--) {
+        crc ^= (uint16_t)*data++ << 8;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+// Byte-at-a-time frame parser and go-back-N receiver. reply() is called
+// with each ACK/NAK to send back; the caller owns the transport.
+struct BtReceiver {
+    enum { WAIT_SOH, SEQ, LEN, PAYLOAD, CRC_HI, CRC_LO } state = WAIT_SOH;
+    uint8_t frame[2 + BT_FRAME_PAYLOAD];  // seq, len, payload
+    size_t got = 0;
+    uint16_t crc = 0;
+
+    uint8_t expected = 0;      // next sequence number wanted
+    bool nakSent = false;      // one NAK per gap, not one per stray frame
+    bool haveHeader = false;
+    bool done = false;
+    uint32_t fileSize = 0;
+    std::string name;
+    std::string data;
+    unsigned long badFrames = 0;
+
+    void (*reply)(uint8_t type, uint8_t seq, void* ctx) = nullptr;
+    void* ctx = nullptr;
+
+    void feed(uint8_t c) {
+        switch (state) {
+        case WAIT_SOH:
+            if (c == BT_SOH) state = SEQ;
+            break;
+        case SEQ:
+            frame[0] = c;
+            state = LEN;
+            break;
+        case LEN:
+            if (c > BT_FRAME_PAYLOAD) {
+                state = WAIT_SOH;  // not a frame, resync
+                break;
+            }
+            frame[1] = c;
+            got = 0;
+            state = c ? PAYLOAD : CRC_HI;
+            break;
+        case PAYLOAD:
+            frame[2 + got++] = c;
+            if (got == frame[1]) state = CRC_HI;
+            break;
+        case CRC_HI:
+            crc = (uint16_t)c << 8;
+            state = CRC_LO;
+            break;
+        case CRC_LO:
+            crc |= c;
+            state = WAIT_SOH;
+            accept();
+            break;
+        }
+    }
+
+    void accept() {
+        if (bt_crc16(0xFFFF, frame, 2 + frame[1]) != crc) {
+            badFrames++;
+            nak();
+            return;
+        }
+        if (frame[0] != expected) {
+            // Duplicate of something already acknowledged: re-ACK it
+            if ((uint8_t)(expected - frame[0]) <= 128) {
+                send(BT_ACK, expected - 1);
+            } else {
+                nak();
+            }
+            return;
+        }
+        const uint8_t* payload = frame + 2;
+        uint8_t length = frame[1];
+        if (!haveHeader) {
+            if (length < 4) {
+                send(BT_CAN, 0);
+                done = true;
+                return;
+            }
+            fileSize = payload[0] | (payload[1] << 8) | (payload[2] << 16) | ((uint32_t)payload[3] << 24);
+            name.assign((const char*)payload + 4, length - 4);
+            haveHeader = true;
+        } else if (length == 0) {
+            done = true;
+        } else {
+            data.append((const char*)payload, length);
+        }
+        send(BT_ACK, expected);
+        expected++;
+        nakSent = false;
+    }
+
+    void nak() {
+        if (nakSent) return;
+        nakSent = true;
+        send(BT_NAK, expected);
+    }
+
+    void send(uint8_t type, uint8_t seq) {
+        if (reply) reply(type, seq, ctx);
+    }
+};
+
+#ifndef BT_CLIENT_NO_MAIN
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#include <time.h>
+
+static void serial_reply(uint8_t type, uint8_t seq, void* ctx) {
+    int fd = *(int*)ctx;
+    uint8_t out[2] = { type, seq };
+    if (write(fd, out, sizeof(out)) != (ssize_t)sizeof(out)) {
+        perror("write");
+    }
+}
+
+static speed_t baud_constant(long baud) {
+    switch (baud) {
+    case 9600: return B9600;
+    case 19200: return B19200;
+    case 38400: return B38400;
+    case 57600: return B57600;
+    case 115200: return B115200;
+    default: return 0;
+    }
+}
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <device> [baud] [output-dir]\n", argv[0]);
+        return 2;
+    }
+    long baud = argc > 2 ? atol(argv[2]) : 9600;
+    std::string outDir = argc > 3 ? argv[3] : ".";
+    speed_t speed = baud_constant(baud);
+    if (!speed) {
+        fprintf(stderr, "unsupported baud rate %ld\n", baud);
+        return 2;
+    }
+
+    int fd = open(argv[1], O_RDWR | O_NOCTTY);
+    if (fd < 0) {
+        perror(argv[1]);
+        return 1;
+    }
+    struct termios tio;
+    tcgetattr(fd, &tio);
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 10;  // 1 s read timeout
+    tcsetattr(fd, TCSANOW, &tio);
+
+    BtReceiver rx;
+    rx.reply = serial_reply;
+    rx.ctx = &fd;
+
+    fprintf(stderr, "waiting for BTSEND on %s at %ld baud\n", argv[1], baud);
+    double start = 0;
+    int idleSeconds = 0;
+    while (!rx.done) {
+        uint8_t buf[256];
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n <= 0) {
+            // Nudge a stalled sender once a header has been seen
+            if (rx.haveHeader && ++idleSeconds >= 3) {
+                rx.nakSent = false;
+                rx.nak();
+                idleSeconds = 0;
+            }
+            continue;
+        }
+        idleSeconds = 0;
+        if (start == 0) start = now_seconds();
+        for (ssize_t i = 0; i < n; i++) rx.feed(buf[i]);
+    }
+    close(fd);
+
+    if (!rx.haveHeader) {
+        fprintf(stderr, "transfer aborted\n");
+        return 1;
+    }
+    if (rx.data.size() != rx.fileSize) {
+        fprintf(stderr, "size mismatch: header says %u, got %zu\n", rx.fileSize, rx.data.size());
+    }
+    std::string path = outDir + "/" + rx.name;
+    FILE* out = fopen(path.c_str(), "wb");
+    if (!out) {
+        perror(path.c_str());
+        return 1;
+    }
+    fwrite(rx.data.data(), 1, rx.data.size(), out);
+    fclose(out);
+    double seconds = now_seconds() - start;
+    fprintf(stderr, "%s: %zu bytes in %.2f s (%.0f B/s), %lu bad frames\n",
+            path.c_str(), rx.data.size(), seconds, seconds > 0 ? rx.data.size() / seconds : 0.0, rx.badFrames);
+    return rx.data.size() == rx.fileSize ? 0 : 1;
+}
+#endif
@@ -0,0 +1,57 @@
+// Host-side decoder for the binary sensor log (distance.bin) written by
+// sensor_log.cpp. Prints the same CSV the LOGCSV command produces.
+//
+//   g++ -O2 -o log_decode log_decode.cpp
+//   ./log_decode distance.bin > distance.csv
+
+#include <stdio.h>
+#include <stdint.h>
+
+// Must match sensor_log.h
+#define SENSOR_LOG_GAP 0xFFFF
+#define SENSOR_LOG_SESSION 0xFFFE
+
+static uint16_t read_le16(const unsigned char* p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <distance.bin>\n", argv[0]);
+        return 2;
+    }
+    FILE* in = fopen(argv[1], "rb");
+    if (!in) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    unsigned char record[4];
+    uint32_t stamp = 0;
+    bool sessionHigh = true;
+    unsigned long rows = 0;
+    unsigned long sessions = 0;
+    printf("millis,value\n");
+    while (fread(record, 1, sizeof(record), in) == sizeof(record)) {
+        uint16_t deltaMs = read_le16(record);
+        uint16_t value = read_le16(record + 2);
+        if (deltaMs == SENSOR_LOG_SESSION) {
+            if (sessionHigh) {
+                stamp = (uint32_t)value << 16;
+                sessions++;
+            } else {
+                stamp |= value;
+            }
+            sessionHigh = !sessionHigh;
+        } else if (deltaMs == SENSOR_LOG_GAP) {
+            stamp += value;
+        } else {
+            stamp += deltaMs;
+            printf("%lu,%u\n", (unsigned long)stamp, value);
+            rows++;
+        }
+    }
+    fclose(in);
+    fprintf(stderr, "%lu records in %lu sessions\n", rows, sessions);
+    return 0;
+}
@@ -0,0 +1,87 @@
+// Host-side decoder for the "stats bin" dump written by task_stats.cpp.
+// Scans a capture of the serial console for the dump and prints one CSV
+// row per task.
+//
+//   g++ -O2 -o stats_decode stats_decode.cpp
+//   ./stats_decode capture.bin > stats.csv
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+// Must match task_stats.h
+#define TASK_STATS_MAGIC "TSTA"
+#define TASK_STATS_VERSION 1
+#define TASK_STATS_RECORD_SIZE 46
+#define TASK_NAME_SIZE 10
+
+static uint32_t read_le(const unsigned char* p, int size) {
+    uint32_t v = 0;
+    for (int i = size - 1; i >= 0; i--) v = (v << 8) | p[i];
+    return v;
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <capture>\n", argv[0]);
+        return 2;
+    }
+    FILE* in = fopen(argv[1], "rb");
+    if (!in) {
+        perror(argv[1]);
+        return 1;
+    }
+    std::vector<unsigned char> data;
+    int c;
+    while ((c = fgetc(in)) != EOF) data.push_back((unsigned char)c);
+    fclose(in);
+
+    // Use the last dump in the capture
+    size_t start = data.size();
+    for (size_t i = 0; i + 7 <= data.size(); i++) {
+        if (memcmp(&data[i], TASK_STATS_MAGIC, 4) == 0) start = i;
+    }
+    if (start == data.size()) {
+        fprintf(stderr, "no stats dump found\n");
+        return 1;
+    }
+    const unsigned char* header = &data[start];
+    if (header[4] != TASK_STATS_VERSION || header[6] != TASK_STATS_RECORD_SIZE) {
+        fprintf(stderr, "unsupported dump version %u / record size %u\n", header[4], header[6]);
+        return 1;
+    }
+    unsigned count = header[5];
+    if (start + 7 + count * TASK_STATS_RECORD_SIZE > data.size()) {
+        fprintf(stderr, "dump truncated\n");
+        return 1;
+    }
+
+    printf("task,runs,exec_min_us,exec_avg_us,exec_max_us,jobs,jitter_avg_ms,jitter_max_ms,overruns,swap_ins,swap_outs,swap_us\n");
+    for (unsigned t = 0; t < count; t++) {
+        const unsigned char* r = header + 7 + t * TASK_STATS_RECORD_SIZE;
+        char name[TASK_NAME_SIZE + 1];
+        memcpy(name, r, TASK_NAME_SIZE);
+        name[TASK_NAME_SIZE] = '\0';
+        const unsigned char* p = r + TASK_NAME_SIZE;
+        uint32_t runs = read_le(p, 4);
+        uint32_t execMin = read_le(p + 4, 4);
+        uint32_t execMax = read_le(p + 8, 4);
+        uint32_t execTotal = read_le(p + 12, 4);
+        uint32_t jobs = read_le(p + 16, 4);
+        uint32_t jitterTotal = read_le(p + 20, 4);
+        printf("%s,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu\n", name,
+               (unsigned long)runs,
+               (unsigned long)(runs ? execMin : 0),
+               (unsigned long)(runs ? execTotal / runs : 0),
+               (unsigned long)execMax,
+               (unsigned long)jobs,
+               (unsigned long)(jobs ? jitterTotal / jobs : 0),
+               (unsigned long)read_le(p + 24, 2),
+               (unsigned long)read_le(p + 26, 2),
+               (unsigned long)read_le(p + 28, 2),
+               (unsigned long)read_le(p + 30, 2),
+               (unsigned long)read_le(p + 32, 4));
+    }
+    return 0;
+}